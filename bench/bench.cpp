@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dlfcn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "elf_image.h"
+#include "elf_module.h"
+#include "elf_module_loader.h"
+using namespace std;
+
+// Compares the loader against dlopen/dlsym on libraries written by bench/generate.cpp
+
+typedef SYSV int (*EntryFunction)(int);
+
+struct BenchConfig {
+    string directory;
+    unsigned symbols;
+    unsigned imports;
+    unsigned depth;
+    unsigned iterations = 20;
+};
+
+static double medianNanoseconds(unsigned iterations, const function<void()> &run) {
+    vector<double> samples;
+    for(unsigned i = 0; i < iterations; i++) {
+        auto start = chrono::steady_clock::now();
+        run();
+        samples.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+    }
+    sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Peak RSS in KiB of a child which runs `run` and exits, the child starts as a copy of this process
+static long childPeakRss(const function<void()> &run) {
+    pid_t pid = fork();
+    if(!pid) {
+        run();
+        _exit(0);
+    }
+    int status;
+    struct rusage usage;
+    if(pid < 0 || wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        return -1;
+    }
+    return usage.ru_maxrss;
+}
+
+static void report(const string &name, double loader, double dl, const char *unit) {
+    char dl_text[32] = "-";
+    if(dl >= 0) {
+        snprintf(dl_text, sizeof(dl_text), "%.1f", dl);
+    }
+    printf("%-36s %14.1f %14s  %s\n", name.c_str(), loader, dl_text, unit);
+}
+
+int main(int argc, char *argv[]) {
+    if((argc != 2 && argc != 4) || (argc == 4 && strcmp(argv[2], "--iterations"))) {
+        cerr << "Usage: " << argv[0] << " [generated directory] [--iterations N]" << endl;
+        return -1;
+    }
+
+    BenchConfig config;
+    config.directory = argv[1];
+    if(argc == 4) {
+        config.iterations = max(1ul, strtoul(argv[3], nullptr, 0));
+    }
+    ifstream config_file(config.directory + "/config");
+    if(!(config_file >> config.symbols >> config.imports >> config.depth)) {
+        cerr << "No generated libraries in " << config.directory << ", run bench-generate first" << endl;
+        return -1;
+    }
+
+    string root_path = config.directory + "/lib_bench_0.so";
+    string host_path = config.directory + "/libbench_host.so";
+
+    // dlopen finds the host library through DT_NEEDED, the loader through shims taken from the same copy
+    void *host = dlopen(host_path.c_str(), RTLD_NOW | RTLD_GLOBAL);
+    if(!host) {
+        cerr << dlerror() << endl;
+        return -1;
+    }
+    ElfModule::DynamicShims shims;
+    for(unsigned i = 0; i < config.imports; i++) {
+        for(string name : {"host_fn_" + to_string(i), "host_data_" + to_string(i)}) {
+            shims[name] = dlsym(host, name.c_str());
+        }
+    }
+    shims.freeze();
+
+    double relocation_nanoseconds = 0;
+    ElfLoadOptions options;
+    options.stats_callback = [&relocation_nanoseconds](const ElfLoadStats &stats) {
+        relocation_nanoseconds += stats.packed_relocation_nanoseconds + stats.relative_relocation_nanoseconds
+            + stats.symbol_resolution_nanoseconds + stats.symbol_relocation_nanoseconds;
+    };
+
+    auto loadModule = [&]() {
+        ElfModuleLoader loader(shims, options);
+        loader.addSearchPath(config.directory);
+        loader.provideLibrary("libbench_host.so");
+        return loader.load(root_path);
+    };
+    auto openLibrary = [&]() {
+        void *handle = dlopen(root_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if(!handle) {
+            cerr << dlerror() << endl;
+            exit(-1);
+        }
+        return handle;
+    };
+
+    // Both have to agree before any of the numbers mean anything
+    shared_ptr<ElfModule> module = loadModule();
+    void *handle = openLibrary();
+    int loader_result = ((EntryFunction)module->getSymbolAddress("bench_0_entry"))(1);
+    int dl_result = ((EntryFunction)dlsym(handle, "bench_0_entry"))(1);
+    if(loader_result != dl_result) {
+        cerr << "Results differ, loader returned " << loader_result << " and dlopen " << dl_result << endl;
+        return -1;
+    }
+
+    printf(
+        "%u libraries, %u exported functions and %u imports each, median of %u runs\n\n",
+        config.depth, config.symbols, config.imports, config.iterations
+    );
+    printf("%-36s %14s %14s\n", "", "elf-loader", "dlopen");
+
+    double parse = medianNanoseconds(config.iterations, [&]() {
+        ElfImage image(root_path);
+    });
+    report("Parse root image", parse / 1000, -1, "us");
+
+    // Still being open would turn dlopen into a reference count bump
+    dlclose(handle);
+
+    vector<shared_ptr<ElfModule>> modules;
+    relocation_nanoseconds = 0;
+    double load = medianNanoseconds(config.iterations, [&]() {
+        modules.push_back(loadModule());
+    });
+    modules.clear();
+    double dl_load = medianNanoseconds(config.iterations, [&]() {
+        dlclose(openLibrary());
+    });
+    report("Load and relocate chain", load / 1000, dl_load / 1000, "us");
+    report("  of which relocation", relocation_nanoseconds / config.iterations / 1000, -1, "us");
+    handle = openLibrary();
+
+    vector<string> hits;
+    vector<string> misses;
+    for(unsigned i = 0; i < config.symbols; i++) {
+        hits.push_back("bench_0_fn_" + to_string(i));
+        misses.push_back("bench_0_missing_" + to_string(i));
+    }
+    ElfImportList hit_list(hits);
+    vector<const void*> addresses(hits.size());
+
+    // dlsym on a handle also searches its dependencies, the loader's lookups only search the root image
+    for(const auto &names : {make_pair("hit", &hits), make_pair("miss", &misses)}) {
+        const vector<string> &symbol_names = *names.second;
+        double lookup = medianNanoseconds(config.iterations, [&]() {
+            for(const string &name : symbol_names) {
+                module->getSymbolAddress(name);
+            }
+        });
+        double dl_lookup = medianNanoseconds(config.iterations, [&]() {
+            for(const string &name : symbol_names) {
+                dlsym(handle, name.c_str());
+            }
+        });
+        report(string("Symbol lookup, ") + names.first, lookup / symbol_names.size(), dl_lookup / symbol_names.size(), "ns");
+    }
+    double batch = medianNanoseconds(config.iterations, [&]() {
+        module->getSymbolAddresses(hit_list, addresses.data());
+    });
+    report("Batch symbol lookup, hit", batch / hits.size(), -1, "ns");
+
+    module.reset();
+    dlclose(handle);
+
+    long baseline_rss = childPeakRss([]() { });
+    long loader_rss = childPeakRss([&]() { loadModule(); });
+    long dl_rss = childPeakRss([&]() { openLibrary(); });
+    report("Peak RSS over baseline", loader_rss - baseline_rss, dl_rss - baseline_rss, "KiB");
+    return 0;
+}
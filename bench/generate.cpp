@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+using namespace std;
+
+// Writes and compiles a chain of synthetic libraries for the bench
+// lib_bench_0.so needs lib_bench_1.so and so on, every library also needs libbench_host.so which stands in
+// for whatever the host would expose through shims
+
+struct GeneratorOptions {
+    unsigned symbols = 1000;    // Exported functions per library
+    unsigned relative = 10000;  // Pointers into the library's own data, each one a RELATIVE relocation
+    unsigned imports = 200;     // Host functions called through the PLT and host variables read through the GOT
+    unsigned data = 65536;      // Bytes of initialized data per library
+    unsigned bss = 65536;       // Bytes of zero initialized data per library
+    unsigned depth = 3;         // Libraries in the DT_NEEDED chain
+};
+
+static void usage(const char *name) {
+    cerr << "Usage: " << name << " [output directory]"
+        << " [--symbols N] [--relative N] [--imports N] [--data BYTES] [--bss BYTES] [--depth N]" << endl;
+}
+
+static bool parseOptions(int argc, char *argv[], GeneratorOptions &options) {
+    for(int i = 2; i < argc; i++) {
+        if(i + 1 >= argc) {
+            return false;
+        }
+        unsigned value = strtoul(argv[i + 1], nullptr, 0);
+        string option = argv[i++];
+        if(option == "--symbols") {
+            options.symbols = value;
+        } else if(option == "--relative") {
+            options.relative = value;
+        } else if(option == "--imports") {
+            options.imports = value;
+        } else if(option == "--data") {
+            options.data = value;
+        } else if(option == "--bss") {
+            options.bss = value;
+        } else if(option == "--depth") {
+            options.depth = value;
+        } else {
+            return false;
+        }
+    }
+    return options.depth > 0 && options.symbols > 0;
+}
+
+static void writeHost(const string &path, const GeneratorOptions &options) {
+    ofstream os(path);
+    for(unsigned i = 0; i < options.imports; i++) {
+        os << "int host_fn_" << i << "(int x) { return x + " << i << "; }\n";
+        os << "int host_data_" << i << " = " << i << ";\n";
+    }
+    // Keeps the library valid when there are no imports
+    os << "int host_version(void) { return 1; }\n";
+}
+
+static void writeLibrary(const string &path, unsigned level, const GeneratorOptions &options) {
+    ofstream os(path);
+    string prefix = "bench_" + to_string(level);
+
+    for(unsigned i = 0; i < options.imports; i++) {
+        os << "extern int host_fn_" << i << "(int x);\n";
+        os << "extern int host_data_" << i << ";\n";
+    }
+    if(level + 1 < options.depth) {
+        os << "extern int bench_" << level + 1 << "_entry(int x);\n";
+    }
+
+    os << "static char " << prefix << "_data[" << (options.data ? options.data : 1) << "] = {1};\n";
+    os << "static char " << prefix << "_bss[" << (options.bss ? options.bss : 1) << "];\n";
+    if(options.relative) {
+        os << "static char *" << prefix << "_pointers[" << options.relative << "] = {\n";
+        for(unsigned i = 0; i < options.relative; i++) {
+            os << "    " << prefix << "_data + " << i % (options.data ? options.data : 1) << ",\n";
+        }
+        os << "};\n";
+    }
+
+    for(unsigned i = 0; i < options.symbols; i++) {
+        os << "int " << prefix << "_fn_" << i << "(int x) { return x + " << i << "; }\n";
+    }
+
+    // Every import is used from code so each gets a JMP_SLOT or GLOB_DAT
+    os << "int " << prefix << "_entry(int x) {\n";
+    os << "    int result = x + " << prefix << "_bss[x & 1];\n";
+    if(options.relative) {
+        os << "    result += *" << prefix << "_pointers[x % " << options.relative << "];\n";
+    }
+    for(unsigned i = 0; i < options.imports; i++) {
+        os << "    result += host_fn_" << i << "(x) + host_data_" << i << ";\n";
+    }
+    if(level + 1 < options.depth) {
+        os << "    result += bench_" << level + 1 << "_entry(x);\n";
+    }
+    os << "    return result;\n";
+    os << "}\n";
+}
+
+static bool compile(const string &directory, const string &source, const string &library, const string &libraries) {
+    const char *cc = getenv("CC");
+    string command = string(cc ? cc : "cc") + " -O1 -shared -fPIC -nostdlib -Wl,-rpath,'$ORIGIN'"
+        + " -o " + directory + "/" + library + " " + directory + "/" + source
+        + " -L" + directory + " " + libraries;
+    cout << command << endl;
+    return !system(command.c_str());
+}
+
+int main(int argc, char *argv[]) {
+    GeneratorOptions options;
+    if(argc < 2 || !parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    string directory = argv[1];
+    mkdir(directory.c_str(), 0755);
+
+    writeHost(directory + "/host.c", options);
+    if(!compile(directory, "host.c", "libbench_host.so", "")) {
+        return -1;
+    }
+
+    // Deepest first so each library can link against the next
+    for(unsigned level = options.depth; level > 0; level--) {
+        string name = "bench_" + to_string(level - 1);
+        string libraries = "-l:libbench_host.so";
+        if(level < options.depth) {
+            libraries = "-l:lib_bench_" + to_string(level) + ".so " + libraries;
+        }
+        writeLibrary(directory + "/" + name + ".c", level - 1, options);
+        if(!compile(directory, name + ".c", "lib_" + name + ".so", libraries)) {
+            return -1;
+        }
+    }
+
+    ofstream config(directory + "/config");
+    config << options.symbols << " " << options.imports << " " << options.depth << endl;
+    return 0;
+}
@@ -140,6 +140,9 @@ typedef struct {
 	Elf64_Sxword	r_addend;	/* Addend. */
 } Elf64_Rela;
 
+/* Packed relative relocations, alternating addresses and bitmaps. */
+typedef Elf64_Xword	Elf64_Relr;
+
 /* Macros for accessing the fields of r_info. */
 #define	ELF64_R_SYM(info)	((info) >> 32)
 #define	ELF64_R_TYPE(info)	((info) & 0xffffffffL)
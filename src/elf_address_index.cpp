@@ -0,0 +1,100 @@
+#include <algorithm>
+#include "elf_address_index.h"
+#include "elf_image.h"
+using namespace std;
+
+struct SymbolInterval {
+    Elf64_Addr start;
+    Elf64_Addr end;
+    const char *name;
+    bool global;
+};
+
+ElfAddressIndex::ElfAddressIndex(const map<Elf64_Half, const ElfSymbolTable> &symbol_tables, size_t image_size) {
+    vector<SymbolInterval> intervals;
+    for(const auto &iterator : symbol_tables) {
+        const ElfSymbolTable &table = iterator.second;
+        for(const Elf64_Sym &symbol : table.symbols) {
+            unsigned char type = ELF64_ST_TYPE(symbol.st_info);
+            if(type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE) {
+                continue;
+            }
+            if(symbol.st_shndx == SHN_UNDEF || symbol.st_shndx == SHN_ABS || !symbol.st_name) {
+                continue;
+            }
+            // Unsized code symbols are usually hand written assembly, they get extended up to the next symbol below
+            if(!symbol.st_size && type != STT_FUNC) {
+                continue;
+            }
+            if(symbol.st_value >= image_size) {
+                continue;
+            }
+            intervals.push_back({
+                symbol.st_value,
+                symbol.st_value + symbol.st_size,
+                &table.strings[symbol.st_name],
+                ELF64_ST_BIND(symbol.st_info) != STB_LOCAL
+            });
+        }
+    }
+
+    // .dynsym and .symtab repeat each other and aliases share an address, keep the widest and prefer exported names
+    sort(intervals.begin(), intervals.end(), [](const SymbolInterval &a, const SymbolInterval &b) {
+        if(a.start != b.start) {
+            return a.start < b.start;
+        }
+        if(a.end != b.end) {
+            return a.end > b.end;
+        }
+        return a.global > b.global;
+    });
+    intervals.erase(
+        unique(intervals.begin(), intervals.end(), [](const SymbolInterval &a, const SymbolInterval &b) {
+            return a.start == b.start;
+        }),
+        intervals.end()
+    );
+
+    for(size_t i = 0; i < intervals.size(); i++) {
+        if(intervals[i].end == intervals[i].start) {
+            intervals[i].end = i + 1 < intervals.size() ? intervals[i + 1].start : image_size;
+        }
+        starts.push_back(intervals[i].start);
+        ends.push_back(intervals[i].end);
+        names.push_back(intervals[i].name);
+    }
+
+    size_t page_count = (image_size >> page_shift) + 1;
+    page_starts.resize(page_count + 1);
+    size_t interval = 0;
+    for(size_t page = 0; page <= page_count; page++) {
+        while(interval < starts.size() && starts[interval] < ((Elf64_Addr)page << page_shift)) {
+            interval++;
+        }
+        page_starts[page] = interval;
+    }
+}
+
+bool ElfAddressIndex::find(Elf64_Addr offset, ElfSymbolLocation &location) const {
+    size_t page = offset >> page_shift;
+    if(page + 1 >= page_starts.size()) {
+        return false;
+    }
+
+    // Only intervals starting in this page can start after `offset`, the one before them may still cover it
+    auto begin = starts.begin() + page_starts[page];
+    auto end = starts.begin() + page_starts[page + 1];
+    size_t index = upper_bound(begin, end, offset) - starts.begin();
+    if(!index) {
+        return false;
+    }
+    index--;
+
+    if(offset >= ends[index]) {
+        return false;
+    }
+    location.name = names[index];
+    location.symbol_offset = starts[index];
+    location.offset = offset - starts[index];
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef __INC_ELF_ADDRESS_INDEX_H_
+#define __INC_ELF_ADDRESS_INDEX_H_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "elf64.h"
+
+class ElfSymbolTable;
+
+struct ElfSymbolLocation {
+    const char *name;
+    Elf64_Addr symbol_offset;  // Relative to the image base
+    Elf64_Xword offset;        // From the start of the symbol
+};
+
+// Answers which symbol covers an image offset
+// Symbols are kept as intervals sorted by start and a table with one entry per 4K of image narrows each search
+// down to the few intervals starting near that page
+class ElfAddressIndex {
+public:
+    ElfAddressIndex(const std::map<Elf64_Half, const ElfSymbolTable> &symbol_tables, size_t image_size);
+
+    // Returns false when no symbol covers `offset`
+    bool find(Elf64_Addr offset, ElfSymbolLocation &location) const;
+
+private:
+    static constexpr unsigned page_shift = 12;
+
+    // Starts are kept apart from the rest so the searches stay within a few cache lines
+    std::vector<Elf64_Addr> starts;
+    std::vector<Elf64_Addr> ends;
+    std::vector<const char*> names;
+
+    // Index of the first interval starting at or after each page, with one extra entry past the end
+    std::vector<uint32_t> page_starts;
+};
+
+#endif//__INC_ELF_ADDRESS_INDEX_H_
@@ -0,0 +1,27 @@
+#ifndef __INC_ELF_CANCEL_TOKEN_H_
+#define __INC_ELF_CANCEL_TOKEN_H_
+
+#include <atomic>
+#include <memory>
+#include "exceptions.h"
+
+// Shared between whoever starts a load and the load itself, once cancelled the load gives up at its next checkpoint
+class ElfCancelToken {
+public:
+    ElfCancelToken() : cancelled(false) { }
+
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> cancelled;
+};
+
+// Throws LoadCancelled once `token` is cancelled, a null token never is
+inline void checkCancelled(const std::shared_ptr<ElfCancelToken> &token) {
+    if(token && token->isCancelled()) {
+        throw LoadCancelled();
+    }
+}
+
+#endif//__INC_ELF_CANCEL_TOKEN_H_
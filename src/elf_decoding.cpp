@@ -45,6 +45,7 @@ const std::string &getSectionTypeName(int type) {
         {SHT_PREINIT_ARRAY, "Pre-initialization function pointers"},
         {SHT_GROUP, "Section group."},
         {SHT_SYMTAB_SHNDX, "Section indexes"},
+        {SHT_RELR, "Relative relocations"},
         {SHT_GNU_HASH, "Hash"},
         {SHT_GNU_LIBLIST, "Library List"},
         {SHT_GNU_verdef, "Symbol versions provided"},
@@ -108,6 +109,7 @@ const std::string &sectionTypeToString(int type) {
         {SHT_PREINIT_ARRAY, "SHT_PREINIT_ARRAY"},
         {SHT_GROUP, "SHT_GROUP"},
         {SHT_SYMTAB_SHNDX, "SHT_SYMTAB_SHNDX"},
+        {SHT_RELR, "SHT_RELR"},
         {SHT_GNU_HASH, "SHT_GNU_HASH"},
         {SHT_GNU_LIBLIST, "SHT_GNU_LIBLIST"},
         {SHT_GNU_verdef, "SHT_GNU_verdef"},
@@ -234,6 +236,9 @@ const std::string &dynamicEntryTypeToString(int type) {
         {DT_PREINIT_ARRAY, "DT_PREINIT_ARRAY"},
         {DT_PREINIT_ARRAYSZ, "DT_PREINIT_ARRAYSZ"},
         {DT_MAXPOSTAGS, "DT_MAXPOSTAGS"},
+        {DT_RELRSZ, "DT_RELRSZ"},
+        {DT_RELR, "DT_RELR"},
+        {DT_RELRENT, "DT_RELRENT"},
         {DT_CHECKSUM, "DT_CHECKSUM"},
         {DT_PLTPADSZ, "DT_PLTPADSZ"},
         {DT_MOVEENT, "DT_MOVEENT"},
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cstring>
+#include "elf_hash.h"
+#include "elf_image.h"
+using namespace std;
+
+uint32_t elfGnuHash(const char *name) {
+    uint32_t hash = 5381;
+    for(const unsigned char *c = (const unsigned char*)name; *c; c++) {
+        hash = hash * 33 + *c;
+    }
+    return hash;
+}
+
+uint32_t elfSysvHash(const char *name) {
+    uint32_t hash = 0;
+    for(const unsigned char *c = (const unsigned char*)name; *c; c++) {
+        hash = (hash << 4) + *c;
+        uint32_t high = hash & 0xf0000000;
+        if(high) {
+            hash ^= high >> 24;
+        }
+        hash &= ~high;
+    }
+    return hash;
+}
+
+ElfImportList::ElfImportList(const vector<string> &names) {
+    for(const string &name : names) {
+        add(name);
+    }
+}
+
+ElfImportList::ElfImportList(const char *const *names, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        add(names[i]);
+    }
+}
+
+void ElfImportList::add(string_view name) {
+    names.emplace_back(name);
+    gnu_hashes.push_back(elfGnuHash(name));
+    sysv_hashes.push_back(elfSysvHash(names.back().c_str()));
+}
+
+static constexpr uint32_t bloom_word_bits = sizeof(Elf64_Xword) * 8;
+
+static bool symbolMatches(const ElfSymbolTable &table, const Elf64_Sym &symbol, const char *name) {
+    return symbol.st_shndx != SHN_UNDEF && !strcmp(&table.strings[symbol.st_name], name);
+}
+
+ElfGnuHashTable::ElfGnuHashTable(shared_ptr<const char[]> section) : section(section) {
+    const uint32_t *header = (const uint32_t*)section.get();
+    bucket_count = header[0];
+    symbol_offset = header[1];
+    bloom_size = header[2];
+    bloom_shift = header[3];
+    bloom = (const Elf64_Xword*)&header[4];
+    buckets = (const uint32_t*)&bloom[bloom_size];
+    chains = &buckets[bucket_count];
+}
+
+const Elf64_Xword *ElfGnuHashTable::getBloomWord(uint32_t hash) const {
+    return &bloom[(hash / bloom_word_bits) % bloom_size];
+}
+
+bool ElfGnuHashTable::bloomMatches(Elf64_Xword word, uint32_t hash) const {
+    Elf64_Xword mask = ((Elf64_Xword)1 << (hash % bloom_word_bits))
+        | ((Elf64_Xword)1 << ((hash >> bloom_shift) % bloom_word_bits));
+    return (word & mask) == mask;
+}
+
+const Elf64_Sym *ElfGnuHashTable::find(const ElfSymbolTable &table, const char *name, uint32_t hash) const {
+    if(!bucket_count || !bloom_size) {
+        return nullptr;
+    }
+
+    // The bloom filter rejects most misses without touching the symbols
+    if(!bloomMatches(*getBloomWord(hash), hash)) {
+        return nullptr;
+    }
+
+    uint32_t index = buckets[hash % bucket_count];
+    if(index < symbol_offset) {
+        return nullptr;
+    }
+    return findInChain(table, name, hash, index);
+}
+
+void ElfGnuHashTable::findBatch(
+    const ElfSymbolTable &table, const ElfImportList &imports, const size_t *indices, size_t count, const Elf64_Sym **results
+) const {
+    constexpr size_t group_size = 8;
+
+    if(!bucket_count || !bloom_size) {
+        return;
+    }
+
+    // Each stage only prefetches what the next one reads so the loads of a whole group are in flight at once
+    for(size_t group = 0; group < count; group += group_size) {
+        size_t group_count = min(group_size, count - group);
+        const size_t *group_indices = &indices[group];
+        uint32_t hashes[group_size];
+        const Elf64_Xword *words[group_size];
+        uint32_t chain_starts[group_size];
+
+        for(size_t i = 0; i < group_count; i++) {
+            hashes[i] = imports.getGnuHash(group_indices[i]);
+            words[i] = getBloomWord(hashes[i]);
+            __builtin_prefetch(words[i]);
+        }
+
+        for(size_t i = 0; i < group_count; i++) {
+            chain_starts[i] = 0;
+            if(bloomMatches(*words[i], hashes[i])) {
+                chain_starts[i] = hashes[i] % bucket_count + 1;
+                __builtin_prefetch(&buckets[chain_starts[i] - 1]);
+            }
+        }
+
+        for(size_t i = 0; i < group_count; i++) {
+            if(!chain_starts[i]) {
+                continue;
+            }
+            uint32_t index = buckets[chain_starts[i] - 1];
+            if(index < symbol_offset || index >= table.symbols.getLength()) {
+                chain_starts[i] = 0;
+                continue;
+            }
+            chain_starts[i] = index;
+            __builtin_prefetch(&chains[index - symbol_offset]);
+            __builtin_prefetch(&table.symbols[index]);
+        }
+
+        for(size_t i = 0; i < group_count; i++) {
+            if(chain_starts[i]) {
+                const char *name = imports.getName(group_indices[i]);
+                const Elf64_Sym *symbol = findInChain(table, name, hashes[i], chain_starts[i]);
+                if(symbol) {
+                    results[group_indices[i]] = symbol;
+                }
+            }
+        }
+    }
+}
+
+const Elf64_Sym *ElfGnuHashTable::findInChain(
+    const ElfSymbolTable &table, const char *name, uint32_t hash, uint32_t index
+) const {
+    // Chain entries hold the hash with the low bit marking the end of the chain
+    for(; index < table.symbols.getLength(); index++) {
+        uint32_t chain_hash = chains[index - symbol_offset];
+        if((chain_hash | 1) == (hash | 1) && symbolMatches(table, table.symbols[index], name)) {
+            return &table.symbols[index];
+        }
+        if(chain_hash & 1) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+ElfSysvHashTable::ElfSysvHashTable(shared_ptr<const char[]> section) : section(section) {
+    const uint32_t *header = (const uint32_t*)section.get();
+    bucket_count = header[0];
+    chain_count = header[1];
+    buckets = &header[2];
+    chains = &buckets[bucket_count];
+}
+
+const Elf64_Sym *ElfSysvHashTable::find(const ElfSymbolTable &table, const char *name, uint32_t hash) const {
+    if(!bucket_count) {
+        return nullptr;
+    }
+
+    for(uint32_t index = buckets[hash % bucket_count]; index != STN_UNDEF; index = chains[index]) {
+        if(index >= chain_count || index >= table.symbols.getLength()) {
+            break;
+        }
+        if(symbolMatches(table, table.symbols[index], name)) {
+            return &table.symbols[index];
+        }
+    }
+    return nullptr;
+}
+
+const Elf64_Sym *ElfSymbolIndex::find(const ElfSymbolTable &table, const char *name, uint32_t hash) {
+    call_once(built, [&]() { build(table); });
+
+    for(uint32_t slot = hash & mask; slots[slot].symbol_index != STN_UNDEF; slot = (slot + 1) & mask) {
+        if(slots[slot].hash == hash) {
+            const Elf64_Sym &symbol = table.symbols[slots[slot].symbol_index];
+            if(!strcmp(&table.strings[symbol.st_name], name)) {
+                return &symbol;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void ElfSymbolIndex::build(const ElfSymbolTable &table) {
+    size_t defined = 0;
+    for(const Elf64_Sym &symbol : table.symbols) {
+        if(symbol.st_shndx != SHN_UNDEF && symbol.st_name) {
+            defined++;
+        }
+    }
+
+    // Keep the load factor at or below one half so probe sequences stay short
+    size_t capacity = 1;
+    while(capacity < defined * 2) {
+        capacity <<= 1;
+    }
+    slots.assign(capacity, Slot{0, STN_UNDEF});
+    mask = capacity - 1;
+
+    // Duplicates probe in insertion order so the first definition in the table wins like a linear scan would
+    for(uint32_t i = 1; i < table.symbols.getLength(); i++) {
+        const Elf64_Sym &symbol = table.symbols[i];
+        if(symbol.st_shndx == SHN_UNDEF || !symbol.st_name) {
+            continue;
+        }
+        uint32_t hash = elfGnuHash(&table.strings[symbol.st_name]);
+        uint32_t slot = hash & mask;
+        while(slots[slot].symbol_index != STN_UNDEF) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = Slot{hash, i};
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef __INC_ELF_HASH_H_
+#define __INC_ELF_HASH_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "elf64.h"
+
+class ElfSymbolTable;
+
+uint32_t elfGnuHash(const char *name);
+// Usable at compile time and on names which aren't null terminated
+constexpr uint32_t elfGnuHash(std::string_view name) {
+    uint32_t hash = 5381;
+    for(char c : name) {
+        hash = hash * 33 + (unsigned char)c;
+    }
+    return hash;
+}
+uint32_t elfSysvHash(const char *name);
+
+// Names to bind together with their hashes, build one up front to resolve the same imports many times
+class ElfImportList {
+public:
+    ElfImportList() { }
+    ElfImportList(const std::vector<std::string> &names);
+    ElfImportList(const char *const *names, size_t count);
+
+    void add(std::string_view name);
+
+    size_t size() const { return names.size(); }
+    const char *getName(size_t index) const { return names[index].c_str(); }
+    uint32_t getGnuHash(size_t index) const { return gnu_hashes[index]; }
+    uint32_t getSysvHash(size_t index) const { return sysv_hashes[index]; }
+
+private:
+    std::vector<std::string> names;
+    std::vector<uint32_t> gnu_hashes;
+    std::vector<uint32_t> sysv_hashes;
+};
+
+// Lookups into the tables the linker emits for the dynamic symbol table
+// Both only ever return defined symbols
+class ElfGnuHashTable {
+public:
+    ElfGnuHashTable(std::shared_ptr<const char[]> section);
+
+    // `hash` is `elfGnuHash(name)`, it's taken separately so callers can hash once for many tables
+    const Elf64_Sym *find(const ElfSymbolTable &table, const char *name, uint32_t hash) const;
+    // Looks up `imports` at `indices` and stores each hit at its import index in `results`, misses are left alone
+    // Groups of names go through the bloom filter, buckets and chains together so their cache misses overlap
+    void findBatch(
+        const ElfSymbolTable &table,
+        const ElfImportList &imports,
+        const size_t *indices,
+        size_t count,
+        const Elf64_Sym **results
+    ) const;
+
+private:
+    const Elf64_Xword *getBloomWord(uint32_t hash) const;
+    bool bloomMatches(Elf64_Xword word, uint32_t hash) const;
+    // `index` is the hash's bucket entry, it has to be at least `symbol_offset`
+    const Elf64_Sym *findInChain(const ElfSymbolTable &table, const char *name, uint32_t hash, uint32_t index) const;
+
+    std::shared_ptr<const char[]> section;
+    uint32_t bucket_count;
+    uint32_t symbol_offset;
+    uint32_t bloom_size;
+    uint32_t bloom_shift;
+    const Elf64_Xword *bloom;
+    const uint32_t *buckets;
+    const uint32_t *chains;
+};
+
+class ElfSysvHashTable {
+public:
+    ElfSysvHashTable(std::shared_ptr<const char[]> section);
+
+    // `hash` is `elfSysvHash(name)`
+    const Elf64_Sym *find(const ElfSymbolTable &table, const char *name, uint32_t hash) const;
+
+private:
+    std::shared_ptr<const char[]> section;
+    uint32_t bucket_count;
+    uint32_t chain_count;
+    const uint32_t *buckets;
+    const uint32_t *chains;
+};
+
+// Open addressing index the loader builds itself for tables the linker didn't hash
+// Slots are (GNU hash, symbol index) pairs so probes rarely have to touch the strings
+class ElfSymbolIndex {
+public:
+    // `hash` is `elfGnuHash(name)`, the index is built on the first call
+    const Elf64_Sym *find(const ElfSymbolTable &table, const char *name, uint32_t hash);
+
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t symbol_index;  // STN_UNDEF marks an empty slot
+    };
+
+    void build(const ElfSymbolTable &table);
+
+    std::once_flag built;
+    std::vector<Slot> slots;
+    uint32_t mask;
+};
+
+#endif//__INC_ELF_HASH_H_
@@ -0,0 +1,174 @@
+#include <cstring>
+#include "exceptions.h"
+#include "elf_header_view.h"
+using namespace std;
+
+Elf64_Ehdr loadElfHeader(ElfSource &source) {
+    Elf64_Ehdr elf_header;
+    source.read(0, sizeof(elf_header), &elf_header);
+
+    if(!IS_ELF(elf_header)) {
+        throw InvalidSignature();
+    }
+
+    if(elf_header.e_ident[EI_CLASS] != ELFCLASS64) {
+        throw UnsupportedElfClass();
+    }
+
+    if(elf_header.e_version != EV_CURRENT) {
+        throw IncompatibleVersion();
+    }
+    return elf_header;
+}
+
+void loadElfHeaderTables(
+    ElfSource &source,
+    const Elf64_Ehdr &elf_header,
+    DynamicArray<const Elf64_Shdr> &section_headers,
+    DynamicArray<const Elf64_Phdr> &program_headers
+) {
+    if(elf_header.e_shentsize != sizeof(Elf64_Shdr)) {
+        throw UnsupportedSectionConfiguration();
+    }
+
+    vector<ElfReadRequest> requests = {
+        {elf_header.e_shoff, elf_header.e_shnum * sizeof(Elf64_Shdr), nullptr, nullptr},
+        {elf_header.e_phoff, elf_header.e_phnum * sizeof(Elf64_Phdr), nullptr, nullptr},
+    };
+    source.readBatch(requests);
+    section_headers = DynamicArray<const Elf64_Shdr>(
+        reinterpret_pointer_cast<const Elf64_Shdr[]>(requests[0].data), elf_header.e_shnum
+    );
+    program_headers = DynamicArray<const Elf64_Phdr>(
+        reinterpret_pointer_cast<const Elf64_Phdr[]>(requests[1].data), elf_header.e_phnum
+    );
+}
+
+ElfHeaderView::ElfHeaderView(const string &path, const ElfLoadOptions &options) {
+    load(*openElfSource(path, options));
+}
+
+ElfHeaderView::ElfHeaderView(int fd, const ElfLoadOptions &options) {
+    load(*openElfSource(fd, options));
+}
+
+ElfHeaderView::ElfHeaderView(shared_ptr<const char[]> buffer, size_t size) {
+    ElfBufferSource source(buffer, size);
+    load(source);
+}
+
+ElfHeaderView::ElfHeaderView(ElfSource &source) {
+    load(source);
+}
+
+bool isExportedSymbol(const Elf64_Sym &symbol) {
+    unsigned char binding = ELF64_ST_BIND(symbol.st_info);
+    unsigned char visibility = ELF64_ST_VISIBILITY(symbol.st_other);
+    // STB_LOOS is STB_GNU_UNIQUE
+    return symbol.st_shndx != SHN_UNDEF
+        && symbol.st_name
+        && (binding == STB_GLOBAL || binding == STB_WEAK || binding == STB_LOOS)
+        && (visibility == STV_DEFAULT || visibility == STV_PROTECTED);
+}
+
+void ElfHeaderView::load(ElfSource &source) {
+    elf_header = loadElfHeader(source);
+    loadElfHeaderTables(source, elf_header, section_headers, program_headers);
+
+    const Elf64_Phdr *dynamic_header = nullptr;
+    for(const Elf64_Phdr &header : program_headers) {
+        if(header.p_type == PT_DYNAMIC) {
+            dynamic_header = &header;
+            break;
+        }
+    }
+    const Elf64_Shdr *symbols_header = nullptr;
+    for(const Elf64_Shdr &header : section_headers) {
+        if(header.sh_type == SHT_DYNSYM) {
+            symbols_header = &header;
+            break;
+        }
+    }
+
+    // Neither depends on the other so they're read together
+    vector<ElfReadRequest> requests;
+    if(dynamic_header) {
+        requests.push_back({dynamic_header->p_offset, dynamic_header->p_filesz, nullptr, nullptr});
+    }
+    if(symbols_header) {
+        requests.push_back({symbols_header->sh_offset, symbols_header->sh_size, nullptr, nullptr});
+    }
+    source.readBatch(requests);
+
+    size_t next_request = 0;
+    if(dynamic_header) {
+        dynamic = DynamicArray<const Elf64_Dyn>(
+            reinterpret_pointer_cast<const Elf64_Dyn[]>(requests[next_request++].data),
+            dynamic_header->p_filesz / sizeof(Elf64_Dyn)
+        );
+    }
+
+    exported_symbol_count = 0;
+    if(symbols_header) {
+        const Elf64_Sym *symbols = (const Elf64_Sym*)requests[next_request].data.get();
+        for(size_t i = 0; i < symbols_header->sh_size / sizeof(Elf64_Sym); i++) {
+            if(isExportedSymbol(symbols[i])) {
+                exported_symbol_count++;
+            }
+        }
+    }
+
+    loadDynamicStrings(source);
+}
+
+void ElfHeaderView::loadDynamicStrings(ElfSource &source) {
+    Elf64_Addr strings_address = 0;
+    Elf64_Xword strings_size = 0;
+    for(const Elf64_Dyn &entry : dynamic) {
+        if(entry.d_tag == DT_NULL) {
+            break;
+        }
+        if(entry.d_tag == DT_STRTAB) {
+            strings_address = entry.d_un.d_ptr;
+        } else if(entry.d_tag == DT_STRSZ) {
+            strings_size = entry.d_un.d_val;
+        }
+    }
+
+    Elf64_Off strings_offset;
+    if(!strings_size || !findFileOffset(strings_address, strings_offset)) {
+        return;
+    }
+    vector<ElfReadRequest> requests = {{strings_offset, strings_size, nullptr, nullptr}};
+    source.readBatch(requests);
+    const char *strings = requests[0].data.get();
+
+    // Nothing says the file is well formed so names are cut off at the end of the table
+    auto getString = [&](Elf64_Xword index) {
+        if(index >= strings_size) {
+            return string();
+        }
+        return string(&strings[index], strnlen(&strings[index], strings_size - index));
+    };
+    for(const Elf64_Dyn &entry : dynamic) {
+        if(entry.d_tag == DT_NULL) {
+            break;
+        }
+        if(entry.d_tag == DT_NEEDED) {
+            needed_libraries.push_back(getString(entry.d_un.d_val));
+        } else if(entry.d_tag == DT_SONAME) {
+            soname = getString(entry.d_un.d_val);
+        }
+    }
+}
+
+bool ElfHeaderView::findFileOffset(Elf64_Addr address, Elf64_Off &offset) const {
+    // Dynamic entries hold addresses, whichever load segment covers one says where it sits in the file
+    for(const Elf64_Phdr &header : program_headers) {
+        if(header.p_type == PT_LOAD && address >= header.p_vaddr && address - header.p_vaddr < header.p_filesz) {
+            offset = header.p_offset + (address - header.p_vaddr);
+            return true;
+        }
+    }
+    return false;
+}
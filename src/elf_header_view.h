@@ -0,0 +1,64 @@
+#ifndef __INC_ELF_HEADER_VIEW_H_
+#define __INC_ELF_HEADER_VIEW_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "elf64.h"
+#include "dynamic_array.h"
+#include "elf_source.h"
+#include "elf_load_options.h"
+
+// Reads the ELF header and checks it's a 64 bit ELF file, the machine is left to the caller
+Elf64_Ehdr loadElfHeader(ElfSource &source);
+// Reads both header tables together
+void loadElfHeaderTables(
+    ElfSource &source,
+    const Elf64_Ehdr &elf_header,
+    DynamicArray<const Elf64_Shdr> &section_headers,
+    DynamicArray<const Elf64_Phdr> &program_headers
+);
+// Whether other modules may bind to `symbol`, it has to be defined, global, weak or unique and default or protected
+bool isExportedSymbol(const Elf64_Sym &symbol);
+
+// Answers what a file is and what it links against without loading it
+// Only the headers, the dynamic segment, .dynsym and the dynamic strings are ever read, nothing is allocated or mapped
+// for the segments and any machine type is accepted
+class ElfHeaderView {
+public:
+    // `map_file` and `io_queue` pick how the file is read, like they do for ElfImage
+    ElfHeaderView(const std::string &path, const ElfLoadOptions &options = ElfLoadOptions());
+    ElfHeaderView(int fd, const ElfLoadOptions &options = ElfLoadOptions());
+    ElfHeaderView(std::shared_ptr<const char[]> buffer, size_t size);
+    ElfHeaderView(ElfSource &source);
+
+    const Elf64_Ehdr &getElfHeader() const { return elf_header; }
+    Elf64_Half getMachine() const { return elf_header.e_machine; }
+    const DynamicArray<const Elf64_Shdr> &getSectionHeaders() const { return section_headers; }
+    const DynamicArray<const Elf64_Phdr> &getProgramHeaders() const { return program_headers; }
+    // Empty for files without a PT_DYNAMIC segment
+    const DynamicArray<const Elf64_Dyn> &getDynamicEntries() const { return dynamic; }
+
+    // DT_NEEDED entries in the order the linker recorded them
+    const std::vector<std::string> &getNeededLibraries() const { return needed_libraries; }
+    // Empty when there is no DT_SONAME
+    const std::string &getSoname() const { return soname; }
+    // Defined global, weak and unique .dynsym entries other modules can see, 0 when the section headers are stripped
+    size_t getExportedSymbolCount() const { return exported_symbol_count; }
+
+private:
+    void load(ElfSource &source);
+    void loadDynamicStrings(ElfSource &source);
+    bool findFileOffset(Elf64_Addr address, Elf64_Off &offset) const;
+
+    Elf64_Ehdr elf_header;
+    DynamicArray<const Elf64_Shdr> section_headers;
+    DynamicArray<const Elf64_Phdr> program_headers;
+    DynamicArray<const Elf64_Dyn> dynamic;
+
+    std::vector<std::string> needed_libraries;
+    std::string soname;
+    size_t exported_symbol_count;
+};
+
+#endif//__INC_ELF_HEADER_VIEW_H_
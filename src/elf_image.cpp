@@ -1,14 +1,25 @@
+#include <algorithm>
 #include <cstring>
 #include <istream>
 #include <string>
 #include <memory>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "exceptions.h"
+#include "elf_cancel_token.h"
 #include "elf_decoding.h"
+#include "elf_header_view.h"
 #include "elf_image.h"
+#include "elf_image_cache.h"
 using namespace std;
 
 ElfSymbolTable::ElfSymbolTable(DynamicArray<const Elf64_Sym> symbols, shared_ptr<const char[]> strings)
-    : symbols(symbols), strings(strings) { }
+    : symbols(symbols), strings(strings), index(make_shared<ElfSymbolIndex>()) { }
+
+const Elf64_Sym *ElfSymbolTable::find(const char *name, uint32_t hash) const {
+    return index->find(*this, name, hash);
+}
 
 void ElfSymbolTable::dump(const ElfImage &image, Elf64_Half section_index, ostream &os) const {
     os << "Symbol Table: " << image.getSectionName(section_index) << endl;
@@ -55,57 +66,254 @@ void ElfRelocations::dump(ostream &os) const {
     }
 }
 
-ElfImage::ElfImage(istream &is) {
-    // Read the header
-    is.read((char*)&elf_header, sizeof(elf_header));
+ElfImage::ElfImage(istream &is, const ElfLoadOptions &options) {
+    ElfStreamSource source(is);
+    load(source, options);
+}
+
+ElfImage::ElfImage(const string &path, const ElfLoadOptions &options) {
+    load(openElfSource(path, options), options);
+}
+
+ElfImage::ElfImage(int fd, const ElfLoadOptions &options) {
+    load(openElfSource(fd, options), options);
+}
+
+ElfImage::ElfImage(shared_ptr<const char[]> buffer, size_t size, const ElfLoadOptions &options) {
+    load(make_shared<ElfBufferSource>(buffer, size), options);
+}
+
+ElfImage::ElfImage(const void *buffer, size_t size, const ElfLoadOptions &options) {
+    load(make_shared<ElfBufferSource>(shared_ptr<const char[]>((const char*)buffer, [](const char*) { }), size), options);
+}
 
-    if(!IS_ELF(elf_header)) {
-        throw InvalidSignature();
+void ElfImage::load(shared_ptr<ElfSource> source, const ElfLoadOptions &options) {
+    // Whether `deferred_source` is set decides if anything gets deferred
+    if(options.lazy_sections) {
+        deferred_source = source;
     }
+    load(*source, options);
+    if(deferred_symbol_tables.empty()) {
+        deferred_source.reset();
+    }
+}
 
-    if(elf_header.e_version != EV_CURRENT) {
-        throw IncompatibleMachineType();
+void ElfImage::load(ElfSource &source, const ElfLoadOptions &options) {
+    if(!options.collect_stats && !options.stats_callback) {
+        loadImage(source, options);
+        return;
+    }
+
+    load_stats.reset(new ElfLoadStats());
+    ElfCountingSource counting_source(source, *load_stats);
+    loadImage(counting_source, options);
+}
+
+void ElfImage::loadImage(ElfSource &source, const ElfLoadOptions &options) {
+    ElfLoadStats *stats = load_stats.get();
+    {
+        ElfStatsTimer timer(stats, &ElfLoadStats::header_nanoseconds);
+        loadHeaders(source);
+    }
+    checkCancelled(options.cancel_token);
+    if(deferred_source) {
+        findDeferredSymbolTables();
+    }
+    {
+        ElfStatsTimer timer(stats, &ElfLoadStats::address_space_nanoseconds);
+        allocateAddressSpace();
+    }
+    // Lazily bound modules are never cached since their GOT points back at this process
+    if(!options.cache_directory.empty() && !options.lazy_binding) {
+        ElfStatsTimer timer(stats, &ElfLoadStats::cache_nanoseconds);
+        cache_key = computeCacheKey(source);
+        restored_from_cache = cache_key && ElfImageCache(options.cache_directory).restore(
+            cache_key, image_base.get(), program_headers, cached_symbol_fixups
+        );
+    }
+
+    // Whatever can't be mapped is planned up front and read in file order together with the sections
+    vector<ElfReadRequest> requests;
+    vector<Elf64_Half> planned_sections;
+    if(!restored_from_cache) {
+        ElfStatsTimer timer(stats, &ElfLoadStats::segment_nanoseconds);
+        // Selectively load segments
+        for(int i = 0; i < elf_header.e_phnum; i++) {
+            switch(program_headers[i].p_type) {
+            case PT_LOAD:
+                planSegment(program_headers[i], source, requests);
+            }
+        }
+    }
+    size_t segment_requests = requests.size();
+    planSections(requests, planned_sections);
+    {
+        ElfStatsTimer timer(stats, &ElfLoadStats::read_nanoseconds);
+        source.readBatch(requests);
+    }
+    checkCancelled(options.cancel_token);
+    for(size_t i = 0; i < planned_sections.size(); i++) {
+        aux_sections[planned_sections[i]] = requests[segment_requests + i].data;
     }
+    if(!restored_from_cache) {
+        ElfStatsTimer timer(stats, &ElfLoadStats::segment_nanoseconds);
+        for(int i = 0; i < elf_header.e_phnum; i++) {
+            switch(program_headers[i].p_type) {
+            case PT_LOAD:
+                clearSegmentTail(program_headers[i]);
+            }
+        }
+    }
+
+    ElfStatsTimer timer(stats, &ElfLoadStats::section_nanoseconds);
+    section_strings = loadSection(elf_header.e_shstrndx, source);
+    loadSections(source);
+}
+
+uint64_t ElfImage::computeCacheKey(ElfSource &source) const {
+    uint64_t key = hashBytes(program_headers.begin(), program_headers.getLength() * sizeof(Elf64_Phdr), 0);
+
+    // The linker's build ID already identifies the contents
+    for(const Elf64_Phdr &header : program_headers) {
+        if(header.p_type != PT_NOTE) {
+            continue;
+        }
+        vector<char> notes(header.p_filesz);
+        source.read(header.p_offset, notes.size(), notes.data());
+        size_t position = 0;
+        while(position + sizeof(Elf64_Nhdr) <= notes.size()) {
+            const Elf64_Nhdr *note = (const Elf64_Nhdr*)&notes[position];
+            size_t name_offset = position + sizeof(Elf64_Nhdr);
+            size_t desc_offset = name_offset + ((note->n_namesz + 3) & ~3ul);
+            if(desc_offset + note->n_descsz > notes.size()) {
+                break;
+            }
+            if(note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && !memcmp(&notes[name_offset], "GNU", 4)) {
+                return hashBytes(&notes[desc_offset], note->n_descsz, key);
+            }
+            position = desc_offset + ((note->n_descsz + 3) & ~3ul);
+        }
+    }
+
+    // Otherwise the file it came from, rewriting a file changes its modification time
+    int fd = source.getFileDescriptor();
+    struct stat file_stat;
+    if(fd < 0 || fstat(fd, &file_stat)) {
+        return 0;
+    }
+    key = hashBytes(&file_stat.st_dev, sizeof(file_stat.st_dev), key);
+    key = hashBytes(&file_stat.st_ino, sizeof(file_stat.st_ino), key);
+    key = hashBytes(&file_stat.st_size, sizeof(file_stat.st_size), key);
+    return hashBytes(&file_stat.st_mtim, sizeof(file_stat.st_mtim), key);
+}
+
+void ElfImage::loadHeaders(ElfSource &source) {
+    elf_header = loadElfHeader(source);
 
     if(elf_header.e_machine != EM_X86_64) {
-        throw IncompatibleVersion();
+        throw IncompatibleMachineType();
     }
 
-    if(elf_header.e_shentsize != sizeof(Elf64_Shdr)) {
-        throw UnsupportedSectionConfiguration();
+    loadElfHeaderTables(source, elf_header, section_headers, program_headers);
+}
+
+void ElfImage::findDeferredSymbolTables() {
+    // Tables relocations refer to are needed up front, the rest only matter to lookups and dumps
+    vector<bool> relocation_tables(elf_header.e_shnum);
+    for(Elf64_Half i = 0; i < elf_header.e_shnum; i++) {
+        if(section_headers[i].sh_type == SHT_RELA && section_headers[i].sh_link < elf_header.e_shnum) {
+            relocation_tables[section_headers[i].sh_link] = true;
+        }
     }
 
-    // Load section headers
-    is.seekg(elf_header.e_shoff);
-    section_headers = DynamicArray<const Elf64_Shdr>(
-        shared_ptr<const Elf64_Shdr[]>(new Elf64_Shdr[elf_header.e_shnum]), elf_header.e_shnum
-    );
-    for(const Elf64_Shdr &header : section_headers) {
-        is.read((char*)&header, sizeof(Elf64_Shdr));
+    for(Elf64_Half i = 0; i < elf_header.e_shnum; i++) {
+        const Elf64_Shdr &header = section_headers[i];
+        if(header.sh_type != SHT_SYMTAB || header.sh_addr || relocation_tables[i] || header.sh_link >= elf_header.e_shnum) {
+            continue;
+        }
+        if(header.sh_size % sizeof(Elf64_Sym) != 0) {
+            throw UnsupportedSymbolConfiguration();
+        }
+        deferred_symbol_tables.push_back(i);
     }
+}
 
-    // Load program headers
-    is.seekg(elf_header.e_phoff);
-    program_headers = DynamicArray<const Elf64_Phdr>(
-        shared_ptr<const Elf64_Phdr[]>(new Elf64_Phdr[elf_header.e_phnum]), elf_header.e_phnum
-    );
-    for(const Elf64_Phdr &header : program_headers) {
-        is.read((char*)&header, sizeof(Elf64_Phdr));
+bool ElfImage::isDeferredSymbolTable(Elf64_Half index) const {
+    return find(deferred_symbol_tables.begin(), deferred_symbol_tables.end(), index) != deferred_symbol_tables.end();
+}
+
+void ElfImage::loadDeferredSymbolTables() const {
+    all_symbol_tables.insert(symbol_tables.begin(), symbol_tables.end());
+
+    vector<ElfReadRequest> requests;
+    for(Elf64_Half index : deferred_symbol_tables) {
+        const Elf64_Shdr &header = section_headers[index];
+        const Elf64_Shdr &strings = section_headers[header.sh_link];
+        requests.push_back({header.sh_offset, header.sh_size, nullptr, nullptr});
+        requests.push_back({strings.sh_offset, strings.sh_size, nullptr, nullptr});
     }
+    deferred_source->readBatch(requests);
 
-    // Load section header string table by known index
-    section_strings = loadSection(elf_header.e_shstrndx, is);
+    for(size_t i = 0; i < deferred_symbol_tables.size(); i++) {
+        size_t count = section_headers[deferred_symbol_tables[i]].sh_size / sizeof(Elf64_Sym);
+        all_symbol_tables.emplace(
+            deferred_symbol_tables[i], ElfSymbolTable(loadTable<Elf64_Sym>(requests[2 * i], count), requests[2 * i + 1].data)
+        );
+    }
 
-    allocateAddressSpace();
+    // Nothing else is ever read so the file can go
+    deferred_source.reset();
+}
 
-    // Selectively load segments
-    for(int i = 0; i < elf_header.e_phnum; i++) {
-        switch(program_headers[i].p_type) {
-        case PT_LOAD:
-            loadSegment(program_headers[i], is);
+const map<Elf64_Half, const ElfSymbolTable> &ElfImage::getSymbolTables() const {
+    if(deferred_symbol_tables.empty()) {
+        return symbol_tables;
+    }
+    call_once(deferred_tables_loaded, [this]() { loadDeferredSymbolTables(); });
+    return all_symbol_tables;
+}
+
+void ElfImage::planSections(vector<ElfReadRequest> &requests, vector<Elf64_Half> &sections) const {
+    // Only sections outside of the segments need reading, the rest are already in the image
+    vector<bool> planned(elf_header.e_shnum);
+    auto plan = [&](Elf64_Half index) {
+        if(index >= elf_header.e_shnum || planned[index]) {
+            return;
+        }
+        const Elf64_Shdr &header = section_headers[index];
+        if(header.sh_addr || header.sh_type == SHT_NOBITS) {
+            return;
+        }
+        planned[index] = true;
+        requests.push_back({header.sh_offset, header.sh_size, nullptr, nullptr});
+        sections.push_back(index);
+    };
+
+    plan(elf_header.e_shstrndx);
+    for(Elf64_Half i = 0; i < elf_header.e_shnum; i++) {
+        switch(section_headers[i].sh_type) {
+        case SHT_SYMTAB:
+        case SHT_DYNSYM:
+            if(!isDeferredSymbolTable(i)) {
+                plan(i);
+                plan(section_headers[i].sh_link);
+            }
+            break;
+
+        case SHT_RELA:
+        case SHT_RELR:
+        case SHT_INIT_ARRAY:
+        case SHT_FINI_ARRAY:
+        case SHT_DYNAMIC:
+        case SHT_GNU_HASH:
+        case SHT_HASH:
+            plan(i);
+            break;
         }
     }
+}
 
+void ElfImage::loadSections(ElfSource &source) {
     // Selectively load section data
     for(int i = 0; i < elf_header.e_shnum; i++) {
         switch(section_headers[i].sh_type) {
@@ -116,28 +324,41 @@ ElfImage::ElfImage(istream &is) {
             // loaded and thus manages the instance variable.
             // This is done because other sections sometimes also load
             // symbol tables
-            loadSymbolTable(i, is);
+            if(!isDeferredSymbolTable(i)) {
+                loadSymbolTable(i, source);
+            }
             break;
 
         case SHT_RELA:
-            relocations.emplace(i, loadRelocations(i, is));
+            relocations.emplace(i, loadRelocations(i, source));
+            break;
+
+        case SHT_RELR:
+            packed_relocations.emplace(i, loadArray<const Elf64_Relr>(i, source));
             break;
 
         case SHT_INIT_ARRAY:
-            init_array.emplace(i, loadArray<const ElfFunction>(i, is));
+            init_array.emplace(i, loadArray<const ElfFunction>(i, source));
             break;
 
         case SHT_FINI_ARRAY:
-            fini_array.emplace(i, loadArray<const ElfFunction>(i, is));
+            fini_array.emplace(i, loadArray<const ElfFunction>(i, source));
             break;
 
         case SHT_DYNAMIC:
-            dynamic.emplace(i, loadArray<const Elf64_Dyn>(i, is));
+            dynamic.emplace(i, loadArray<const Elf64_Dyn>(i, source));
+            break;
+
+        case SHT_GNU_HASH:
+            gnu_hash_tables.emplace(section_headers[i].sh_link, ElfGnuHashTable(loadSection(i, source)));
+            break;
+
+        case SHT_HASH:
+            sysv_hash_tables.emplace(section_headers[i].sh_link, ElfSysvHashTable(loadSection(i, source)));
             break;
 
         case SHT_NULL:  // This section is not used
         case SHT_NOTE:  // There's very little information about this available
-        case SHT_GNU_HASH:  // This isn't needed to run but it boosts performance
         case SHT_STRTAB:  // These are loaded by other sections
         case SHT_GNU_verdef:  // These are only required if we need symbol versioning
         case SHT_GNU_verneed:  // These are only required if we need symbol versioning
@@ -167,7 +388,7 @@ void ElfImage::dump(ostream &os) const {
     }
 
     // Dump symbols
-    for(auto iterator : symbol_tables) {
+    for(auto iterator : getSymbolTables()) {
         const ElfSymbolTable &symbols = iterator.second;
         iterator.second.dump(*this, iterator.first, os);
     }
@@ -177,6 +398,10 @@ void ElfImage::dump(ostream &os) const {
         iterator.second->dump(os);
     }
 
+    for(auto iterator : packed_relocations) {
+        dumpPackedRelocations(iterator.second, os);
+    }
+
     // Dump init array
     for(auto iterator : init_array) {
         dumpFunctionArray("Init", iterator.second, os);
@@ -206,78 +431,435 @@ const map<Elf64_Half, unique_ptr<const ElfRelocations>> &ElfImage::getRelocation
     return relocations;
 }
 
+vector<string> ElfImage::getNeededLibraries() const {
+    vector<string> needed;
+    const Elf64_Dyn *string_table = findDynamicEntry(DT_STRTAB);
+    if(!string_table) {
+        return needed;
+    }
+
+    // DT_STRTAB is part of a loaded segment so the names are read straight out of the image
+    const char *strings = image_base.get() + string_table->d_un.d_ptr;
+    for(const auto &iterator : dynamic) {
+        for(const Elf64_Dyn &entry : iterator.second) {
+            if(entry.d_tag == DT_NULL) {
+                break;
+            }
+            if(entry.d_tag == DT_NEEDED) {
+                needed.push_back(&strings[entry.d_un.d_val]);
+            }
+        }
+    }
+    return needed;
+}
+
+const Elf64_Dyn *ElfImage::findDynamicEntry(Elf64_Sxword tag) const {
+    for(const auto &iterator : dynamic) {
+        for(const Elf64_Dyn &entry : iterator.second) {
+            if(entry.d_tag == tag) {
+                return &entry;
+            }
+            if(entry.d_tag == DT_NULL) {
+                break;
+            }
+        }
+    }
+    return nullptr;
+}
+
+const map<Elf64_Half, const DynamicArray<const Elf64_Relr>> &ElfImage::getPackedRelocations() const {
+    return packed_relocations;
+}
+
+void ElfImage::releaseRelocations(const ElfRelocations *keep) {
+    vector<Elf64_Half> released;
+    for(auto iterator = relocations.begin(); iterator != relocations.end();) {
+        if(iterator->second.get() == keep) {
+            iterator++;
+            continue;
+        }
+        released.push_back(iterator->first);
+        iterator = relocations.erase(iterator);
+    }
+    for(const auto &iterator : packed_relocations) {
+        released.push_back(iterator.first);
+    }
+    packed_relocations.clear();
+
+    for(Elf64_Half index : released) {
+        const Elf64_Shdr &header = section_headers[index];
+        if(!header.sh_addr) {
+            aux_sections.erase(index);
+            continue;
+        }
+
+        // Resident tables share pages with the rest of the image, only the pages holding nothing else go back
+        size_t start = pageCeil(header.sh_addr);
+        size_t end = pageFloor(header.sh_addr + header.sh_size);
+        if(start < end) {
+            madvise(&image_base[start], end - start, MADV_DONTNEED);
+        }
+    }
+}
+
 void ElfImage::allocateAddressSpace() {
     Elf64_Addr highestOffset = 0;
-    Elf64_Xword size = 0;
+    Elf64_Xword alignment = getPageSize();
 
-    // Get the highest described virtual address
+    // Get the highest described virtual address and the strictest alignment
     for(int i = 0; i < elf_header.e_phnum; i++) {
         switch(program_headers[i].p_type) {
         case PT_LOAD:
+            // Like ld.so, refuse segments whose file pages don't line up with their memory pages
+            // Otherwise two segments can land on one page and whichever is protected last wins
+            if((program_headers[i].p_vaddr - program_headers[i].p_offset) % getPageSize()) {
+                throw UnalignedSegment();
+            }
             // These SHOULD already be sorted by address but just in case...
-            if(program_headers[i].p_vaddr > highestOffset) {
-                highestOffset = program_headers[i].p_vaddr;
-                size = program_headers[i].p_memsz;
+            if(program_headers[i].p_vaddr + program_headers[i].p_memsz > highestOffset) {
+                highestOffset = program_headers[i].p_vaddr + program_headers[i].p_memsz;
+            }
+            if(program_headers[i].p_align > alignment) {
+                alignment = program_headers[i].p_align;
+            }
+        }
+    }
+
+    // Nothing is accessible until a segment claims it
+    // Over-reserve so the base can be aligned and then give back the slack
+    size_t length = pageCeil(highestOffset);
+    size_t reserved_length = length + alignment - getPageSize();
+    char *reserved = (char*)mmap(nullptr, reserved_length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(reserved == MAP_FAILED) {
+        throw AddressSpaceError();
+    }
+
+    char *ptr = (char*)(((size_t)reserved + alignment - 1) / alignment * alignment);
+    if(ptr != reserved) {
+        munmap(reserved, ptr - reserved);
+    }
+    if(ptr + length != reserved + reserved_length) {
+        munmap(ptr + length, reserved + reserved_length - (ptr + length));
+    }
+
+    image_base = shared_ptr<char[]>(ptr, [length](char *ptr) {
+        munmap(ptr, length);
+    });
+    image_size = length;
+
+    // Segments stay writable until relocation is done, see `protectSegments`
+    for(int i = 0; i < elf_header.e_phnum; i++) {
+        switch(program_headers[i].p_type) {
+        case PT_LOAD:
+            size_t start = pageFloor(program_headers[i].p_vaddr);
+            size_t end = pageCeil(program_headers[i].p_vaddr + program_headers[i].p_memsz);
+            if(mprotect(&image_base[start], end - start, PROT_READ | PROT_WRITE)) {
+                throw ProtectionError();
             }
         }
     }
+}
 
-    image_base = shared_ptr<char[]>(new char[highestOffset + size]);
+struct ProtectionRange {
+    size_t start;
+    size_t end;
+    int prot;
+};
+
+static int segmentFlagsToProt(Elf64_Word flags) {
+    int prot = PROT_NONE;
+    if(flags & PF_R) {
+        prot |= PROT_READ;
+    }
+    if(flags & PF_W) {
+        prot |= PROT_WRITE;
+    }
+    if(flags & PF_X) {
+        prot |= PROT_EXEC;
+    }
+    return prot;
 }
 
-const void *ElfImage::getSymbolAddress(const std::string &symbol_name) {
-    for(auto iterator : symbol_tables) {
-        const ElfSymbolTable &table = iterator.second;
-        for(const Elf64_Sym &symbol : table.symbols) {
-            const char *name = &table.strings[symbol.st_name];
-            if(!strcmp(name, symbol_name.c_str())) {
-                return (const void*)(image_base.get() + symbol.st_value);
+void ElfImage::protectSegments() {
+    vector<ProtectionRange> ranges;
+    for(const Elf64_Phdr &header : program_headers) {
+        if(header.p_type == PT_LOAD) {
+            ranges.push_back({
+                pageFloor(header.p_vaddr), pageCeil(header.p_vaddr + header.p_memsz), segmentFlagsToProt(header.p_flags)
+            });
+        }
+    }
+
+    // Carve read-only islands out of the writable segments for the data only relocation needed to write
+    for(const Elf64_Phdr &header : program_headers) {
+        if(header.p_type == PT_GNU_RELRO) {
+            size_t relro_start = pageFloor(header.p_vaddr);
+            size_t relro_end = pageFloor(header.p_vaddr + header.p_memsz);
+            vector<ProtectionRange> split;
+            for(const ProtectionRange &range : ranges) {
+                if(range.end <= relro_start || range.start >= relro_end) {
+                    split.push_back(range);
+                    continue;
+                }
+                if(range.start < relro_start) {
+                    split.push_back({range.start, relro_start, range.prot});
+                }
+                split.push_back({max(range.start, relro_start), min(range.end, relro_end), PROT_READ});
+                if(range.end > relro_end) {
+                    split.push_back({relro_end, range.end, range.prot});
+                }
+            }
+            ranges = split;
+        }
+    }
+
+    // Segments which aren't page aligned in memory can share a page, it gets what every one of them needs
+    vector<size_t> bounds;
+    for(const ProtectionRange &range : ranges) {
+        bounds.push_back(range.start);
+        bounds.push_back(range.end);
+    }
+    sort(bounds.begin(), bounds.end());
+    bounds.erase(unique(bounds.begin(), bounds.end()), bounds.end());
+
+    // Merge neighbours so there is one call per distinct run of pages
+    vector<ProtectionRange> merged;
+    for(size_t i = 1; i < bounds.size(); i++) {
+        bool covered = false;
+        int prot = PROT_NONE;
+        for(const ProtectionRange &range : ranges) {
+            if(range.start <= bounds[i - 1] && range.end >= bounds[i]) {
+                covered = true;
+                prot |= range.prot;
             }
         }
+        if(!covered) {
+            continue;
+        }
+        if(!merged.empty() && merged.back().end == bounds[i - 1] && merged.back().prot == prot) {
+            merged.back().end = bounds[i];
+        } else {
+            merged.push_back({bounds[i - 1], bounds[i], prot});
+        }
+    }
+
+    for(const ProtectionRange &range : merged) {
+        if(mprotect(&image_base[range.start], range.end - range.start, range.prot)) {
+            throw ProtectionError();
+        }
+    }
+}
+
+const void *ElfImage::getSymbolAddress(const std::string &symbol_name) const {
+    return getSymbolAddress(symbol_name.c_str());
+}
+
+const void *ElfImage::getSymbolAddress(const char *symbol_name) const {
+    return getSymbolAddress(symbol_name, elfGnuHash(symbol_name));
+}
+
+const void *ElfImage::getSymbolAddress(const char *symbol_name, uint32_t gnu_hash) const {
+    const void *address = findSymbolAddress(symbol_tables, symbol_name, gnu_hash);
+    // Only a miss in everything loaded up front is worth reading the deferred tables for
+    if(!address && !deferred_symbol_tables.empty()) {
+        address = findSymbolAddress(getSymbolTables(), symbol_name, gnu_hash);
+    }
+    return address;
+}
+
+const void *ElfImage::getExportedSymbolAddress(const char *symbol_name, uint32_t gnu_hash) const {
+    // .dynsym is never deferred so `lazy_sections` doesn't matter here
+    for(const auto &iterator : symbol_tables) {
+        if(section_headers[iterator.first].sh_type != SHT_DYNSYM) {
+            continue;
+        }
+        const Elf64_Sym *symbol = findSymbol(iterator.first, iterator.second, symbol_name, gnu_hash);
+        if(symbol && isExportedSymbol(*symbol)) {
+            return (const void*)(image_base.get() + symbol->st_value);
+        }
+    }
+    return nullptr;
+}
+
+const void *ElfImage::findSymbolAddress(
+    const map<Elf64_Half, const ElfSymbolTable> &tables, const char *name, uint32_t gnu_hash
+) const {
+    for(const auto &iterator : tables) {
+        const Elf64_Sym *symbol = findSymbol(iterator.first, iterator.second, name, gnu_hash);
+        if(symbol) {
+            return (const void*)(image_base.get() + symbol->st_value);
+        }
     }
 
     // TODO: Use exceptions here?
     return nullptr;
 }
 
-void ElfImage::loadSegment(const Elf64_Phdr &header, istream &is) {
-    is.seekg(header.p_offset);
+bool ElfImage::findSymbolAt(const void *address, ElfSymbolLocation &location) const {
+    if(address < image_base.get() || address >= image_base.get() + image_size) {
+        return false;
+    }
+    call_once(address_index_built, [&]() {
+        address_index.reset(new ElfAddressIndex(getSymbolTables(), image_size));
+    });
+    return address_index->find((const char*)address - image_base.get(), location);
+}
+
+size_t ElfImage::getSymbolAddresses(const ElfImportList &imports, const void **addresses) const {
+    vector<const Elf64_Sym*> symbols(imports.size());
+    vector<size_t> pending(imports.size());
+    for(size_t i = 0; i < pending.size(); i++) {
+        pending[i] = i;
+    }
+
+    // Tables are searched in the same order as single lookups so both agree on which definition wins
+    auto search = [&](Elf64_Half section_index, const ElfSymbolTable &table) {
+        auto gnu_iterator = gnu_hash_tables.find(section_index);
+        auto sysv_iterator = sysv_hash_tables.find(section_index);
+        if(gnu_iterator != gnu_hash_tables.end()) {
+            gnu_iterator->second.findBatch(table, imports, pending.data(), pending.size(), symbols.data());
+        } else {
+            for(size_t index : pending) {
+                const char *name = imports.getName(index);
+                if(sysv_iterator != sysv_hash_tables.end()) {
+                    symbols[index] = sysv_iterator->second.find(table, name, imports.getSysvHash(index));
+                } else {
+                    symbols[index] = table.find(name, imports.getGnuHash(index));
+                }
+            }
+        }
+
+        pending.erase(
+            remove_if(pending.begin(), pending.end(), [&](size_t index) { return symbols[index]; }), pending.end()
+        );
+    };
+
+    for(const auto &iterator : symbol_tables) {
+        if(pending.empty()) {
+            break;
+        }
+        search(iterator.first, iterator.second);
+    }
+    if(!pending.empty() && !deferred_symbol_tables.empty()) {
+        for(const auto &iterator : getSymbolTables()) {
+            if(!pending.empty() && isDeferredSymbolTable(iterator.first)) {
+                search(iterator.first, iterator.second);
+            }
+        }
+    }
+
+    for(size_t i = 0; i < symbols.size(); i++) {
+        addresses[i] = symbols[i] ? (const void*)(image_base.get() + symbols[i]->st_value) : nullptr;
+    }
+    return imports.size() - pending.size();
+}
+
+size_t ElfImage::getSymbolAddresses(const char *const *symbol_names, size_t count, const void **addresses) const {
+    return getSymbolAddresses(ElfImportList(symbol_names, count), addresses);
+}
+
+const Elf64_Sym *ElfImage::findSymbol(
+    Elf64_Half section_index, const ElfSymbolTable &table, const char *name, uint32_t gnu_hash
+) const {
+    auto gnu_iterator = gnu_hash_tables.find(section_index);
+    if(gnu_iterator != gnu_hash_tables.end()) {
+        return gnu_iterator->second.find(table, name, gnu_hash);
+    }
+
+    auto sysv_iterator = sysv_hash_tables.find(section_index);
+    if(sysv_iterator != sysv_hash_tables.end()) {
+        return sysv_iterator->second.find(table, name, elfSysvHash(name));
+    }
+
+    // Tables like .symtab never have a hash table so we index them ourselves
+    return table.find(name, gnu_hash);
+}
+
+// Serves the bytes from the source directly when it can, otherwise copies them out
+static shared_ptr<const char[]> loadBytes(Elf64_Off offset, size_t size, ElfSource &source) {
+    shared_ptr<const char[]> ptr = source.view(offset, size);
+    if(!ptr) {
+        shared_ptr<char[]> buffer(new char[size]);
+        source.read(offset, size, buffer.get());
+        ptr = buffer;
+    }
+    return ptr;
+}
+
+void ElfImage::planSegment(const Elf64_Phdr &header, ElfSource &source, vector<ElfReadRequest> &requests) {
     char *ptr = &image_base[header.p_vaddr];
-    is.read(ptr, header.p_memsz);
+    size_t file_size = min(header.p_filesz, header.p_memsz);
+    if(!source.map(ptr, header.p_offset, file_size)) {
+        requests.push_back({header.p_offset, file_size, ptr, nullptr});
+    }
 }
 
-shared_ptr<const char[]> ElfImage::loadSection(Elf64_Half index, istream &is) {
-    shared_ptr<char[]> ptr;
+void ElfImage::clearSegmentTail(const Elf64_Phdr &header) {
+    char *ptr = &image_base[header.p_vaddr];
+    size_t file_size = min(header.p_filesz, header.p_memsz);
+
+    // Everything past the file contents is .bss
+    // Whole pages get fresh zero pages from the kernel instead of being touched at all,
+    // except for the page a later segment starts in since that one's contents are already there
+    size_t file_end = (size_t)ptr + file_size;
+    size_t memory_end = (size_t)ptr + header.p_memsz;
+    size_t zero_start = pageCeil(file_end);
+    size_t zero_end = pageCeil(memory_end);
+    for(const Elf64_Phdr &other : program_headers) {
+        if(other.p_type == PT_LOAD && other.p_vaddr >= header.p_vaddr + header.p_memsz) {
+            zero_end = min(zero_end, pageFloor((size_t)&image_base[other.p_vaddr]));
+        }
+    }
+    if(zero_start < zero_end) {
+        void *zero_pages = mmap(
+            (void*)zero_start, zero_end - zero_start, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0
+        );
+        if(zero_pages == MAP_FAILED) {
+            throw AddressSpaceError();
+        }
+    } else {
+        zero_start = zero_end = memory_end;
+    }
+
+    // The rest of the last file page may hold whatever follows in the file so that part is cleared by hand,
+    // as is the part of the last page shared with the next segment
+    memset((char*)file_end, 0, zero_start - file_end);
+    if(zero_end < memory_end) {
+        memset((char*)zero_end, 0, memory_end - zero_end);
+    }
+}
+
+shared_ptr<const char[]> ElfImage::loadSection(Elf64_Half index, ElfSource &source) {
+    shared_ptr<const char[]> ptr;
     if(section_headers[index].sh_addr) {  // Resident Section
-        ptr = shared_ptr<char[]>(image_base, &image_base[section_headers[index].sh_addr]);
+        ptr = shared_ptr<const char[]>(image_base, &image_base[section_headers[index].sh_addr]);
     } else {  // Non resident section
-        shared_ptr<char[]> &ptr_ref = aux_sections[index];
+        shared_ptr<const char[]> &ptr_ref = aux_sections[index];
         if(!ptr_ref) {
-            ptr_ref.reset(new char[section_headers[index].sh_size]);
-            is.seekg(section_headers[index].sh_offset);
-            is.read(ptr_ref.get(), section_headers[index].sh_size);
+            ptr_ref = loadBytes(section_headers[index].sh_offset, section_headers[index].sh_size, source);
         }
         ptr = ptr_ref;
     }
     return ptr;
 }
 
-unique_ptr<const ElfRelocations> ElfImage::loadRelocations(Elf64_Half section_index, istream &is) {
-    const DynamicArray<const Elf64_Rela> entries = loadArray<const Elf64_Rela>(section_index, is);
-    const ElfSymbolTable table = loadSymbolTable(section_headers[section_index].sh_link, is);
+unique_ptr<const ElfRelocations> ElfImage::loadRelocations(Elf64_Half section_index, ElfSource &source) {
+    const DynamicArray<const Elf64_Rela> entries = loadArray<const Elf64_Rela>(section_index, source);
+    const ElfSymbolTable table = loadSymbolTable(section_headers[section_index].sh_link, source);
     unique_ptr<const ElfRelocations> ptr =  unique_ptr<const ElfRelocations>(new ElfRelocations(entries, table));
     return ptr;
 }
 
-const ElfSymbolTable ElfImage::loadSymbolTable(Elf64_Half section_index, istream &is) {
+const ElfSymbolTable ElfImage::loadSymbolTable(Elf64_Half section_index, ElfSource &source) {
     if(section_headers[section_index].sh_size % sizeof(Elf64_Sym) != 0) {
         throw UnsupportedSymbolConfiguration();
     }
 
     auto iterator = symbol_tables.find(section_index);
     if(iterator == symbol_tables.end()) {
-        DynamicArray<const Elf64_Sym> symbols = loadArray<const Elf64_Sym>(section_index, is);
-        shared_ptr<const char[]> strings = loadSection(section_headers[section_index].sh_link, is);
+        ElfStatsTimer timer(load_stats.get(), &ElfLoadStats::symbol_table_nanoseconds);
+        DynamicArray<const Elf64_Sym> symbols = loadArray<const Elf64_Sym>(section_index, source);
+        shared_ptr<const char[]> strings = loadSection(section_headers[section_index].sh_link, source);
 
         auto emplace_result = symbol_tables.emplace(
             section_index, ElfSymbolTable(symbols, strings)
@@ -288,15 +870,20 @@ const ElfSymbolTable ElfImage::loadSymbolTable(Elf64_Half section_index, istream
 }
 
 template <typename DataType>
-DynamicArray<DataType> ElfImage::loadArray(Elf64_Half section_index, istream &is) {
+DynamicArray<DataType> ElfImage::loadArray(Elf64_Half section_index, ElfSource &source) {
     size_t num_entries =  section_headers[section_index].sh_size / sizeof(DataType);
     shared_ptr<const DataType[]> ptr = reinterpret_pointer_cast<const DataType[]>(
-        loadSection(section_index, is)
+        loadSection(section_index, source)
     );
     // TODO: Should this be `const DataType`?
     return DynamicArray<DataType>(ptr, num_entries);
 }
 
+template <typename DataType>
+DynamicArray<const DataType> ElfImage::loadTable(const ElfReadRequest &request, size_t count) {
+    return DynamicArray<const DataType>(reinterpret_pointer_cast<const DataType[]>(request.data), count);
+}
+
 void dumpElfHeader(const Elf64_Ehdr header, ostream &os) {
     os << "Type: " << header.e_type
         << " (" << elfTypeToString(header.e_type) << ')' << endl;
@@ -381,3 +968,14 @@ void dumpDynamicEntry(const Elf64_Dyn entry, ostream &os) {
     os << "Dynamic Entry Value: " << (void*)entry.d_un.d_ptr << endl;
     os << endl;
 }
+
+void dumpPackedRelocations(const DynamicArray<const Elf64_Relr> entries, ostream &os) {
+    for(const Elf64_Relr entry : entries) {
+        if(entry & 1) {
+            os << "Packed Relocation Bitmap: " << (void*)entry << endl;
+        } else {
+            os << "Packed Relocation Offset: " << (void*)entry << endl;
+        }
+    }
+    os << endl;
+}
@@ -5,8 +5,15 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <vector>
 #include "elf64.h"
 #include "dynamic_array.h"
+#include "elf_source.h"
+#include "elf_hash.h"
+#include "elf_image_cache.h"
+#include "elf_address_index.h"
+#include "elf_load_options.h"
 
 // Because of course different platforms have their own impl of calling conventions, ugh
 // I should just be happy there's a decorator for it
@@ -22,9 +29,15 @@ public:
 
     void dump(const ElfImage &image, Elf64_Half section_index, std::ostream &os) const;
 
-    // TODO: Use some kind of hash table for this
+    // Finds a defined symbol using an index built on first use, `hash` is `elfGnuHash(name)`
+    const Elf64_Sym *find(const char *name, uint32_t hash) const;
+
     const DynamicArray<const Elf64_Sym> symbols;
     const std::shared_ptr<const char[]> strings;
+
+private:
+    // Shared so every copy of the table builds and uses the same index
+    std::shared_ptr<ElfSymbolIndex> index;
 };
 
 class ElfRelocations {
@@ -39,7 +52,15 @@ public:
 
 class ElfImage {
 public:
-    ElfImage(std::istream &is);
+    ElfImage(std::istream &is, const ElfLoadOptions &options = ElfLoadOptions());
+    // Maps the file instead of reading it, headers and sections are served from the mapping
+    // Without `map_file` everything is read with a few large preads instead
+    ElfImage(const std::string &path, const ElfLoadOptions &options = ElfLoadOptions());
+    ElfImage(int fd, const ElfLoadOptions &options = ElfLoadOptions());
+    // Parses an image already in memory in place, headers and sections alias the buffer
+    ElfImage(std::shared_ptr<const char[]> buffer, size_t size, const ElfLoadOptions &options = ElfLoadOptions());
+    // Same but the caller has to keep `buffer` alive for as long as the image
+    ElfImage(const void *buffer, size_t size, const ElfLoadOptions &options = ElfLoadOptions());
 
     void dump(std::ostream &os) const;
 
@@ -47,39 +68,132 @@ public:
     std::shared_ptr<const char[]> getSectionName(Elf64_Half index) const;
 
     const std::map<Elf64_Half, std::unique_ptr<const ElfRelocations>> &getRelocations() const;
-
-    const void *getSymbolAddress(const std::string &symbol_name);
+    const std::map<Elf64_Half, const DynamicArray<const Elf64_Relr>> &getPackedRelocations() const;
+
+    // Uses the linker's hash tables when present and only scans tables which have none
+    const void *getSymbolAddress(const std::string &symbol_name) const;
+    const void *getSymbolAddress(const char *symbol_name) const;
+    // For callers searching many images, `gnu_hash` is `elfGnuHash(symbol_name)`
+    const void *getSymbolAddress(const char *symbol_name, uint32_t gnu_hash) const;
+    // Only what other modules may bind to, that's exported .dynsym entries and never locals or hidden symbols
+    // Linking uses this, .symtab is left to lookups made on the image itself
+    const void *getExportedSymbolAddress(const char *symbol_name, uint32_t gnu_hash) const;
+    // Resolves every import into `addresses` in one pass, misses are null
+    // Returns the number of imports found
+    size_t getSymbolAddresses(const ElfImportList &imports, const void **addresses) const;
+    size_t getSymbolAddresses(const char *const *symbol_names, size_t count, const void **addresses) const;
+
+    // Null unless the image was loaded with `collect_stats` or a `stats_callback`
+    const ElfLoadStats *getLoadStats() const { return load_stats.get(); }
+
+    // Finds the symbol covering `address` inside the image, the index behind this is built on the first call
+    // Returns false when no symbol covers it
+    bool findSymbolAt(const void *address, ElfSymbolLocation &location) const;
+
+    // DT_NEEDED entries in the order the linker recorded them
+    std::vector<std::string> getNeededLibraries() const;
 
 // protected:
     void *getImageBase() const { return image_base.get(); }
+    size_t getImageSize() const { return image_size; }
+
+protected:
+    // For subclasses adding their own phases, null when stats are off
+    ElfLoadStats *getWritableLoadStats() { return load_stats.get(); }
+
+    // Applies each segment's own protection, should be called once relocation is done
+    void protectSegments();
+
+    const Elf64_Shdr &getSectionHeader(Elf64_Half index) const { return section_headers[index]; }
+    const DynamicArray<const Elf64_Phdr> &getProgramHeaders() const { return program_headers; }
+    // Every symbol table, reading any `lazy_sections` left out first
+    const std::map<Elf64_Half, const ElfSymbolTable> &getSymbolTables() const;
+    const std::map<Elf64_Half, const DynamicArray<const ElfFunction>> &getInitArrays() const { return init_array; }
+    const std::map<Elf64_Half, const DynamicArray<const ElfFunction>> &getFiniArrays() const { return fini_array; }
+    // Returns the first entry with `tag` in any dynamic section or null if there is none
+    const Elf64_Dyn *findDynamicEntry(Elf64_Sxword tag) const;
+    // Drops every relocation table except `keep` and gives back the pages only they used
+    void releaseRelocations(const ElfRelocations *keep);
+
+    // Zero unless `cache_directory` is set and the image has a build ID or comes from a file
+    uint64_t getCacheKey() const { return cache_key; }
+    // The segments came from the cache already relocated, only the symbol slots are left to write
+    bool isRestoredFromCache() const { return restored_from_cache; }
+    std::vector<ElfSymbolFixup> takeCachedSymbolFixups() { return std::move(cached_symbol_fixups); }
 
 private:
+    void load(ElfSource &source, const ElfLoadOptions &options);
+    // Holds on to `source` when `lazy_sections` left anything to read later
+    void load(std::shared_ptr<ElfSource> source, const ElfLoadOptions &options);
+    void loadImage(ElfSource &source, const ElfLoadOptions &options);
+    void loadHeaders(ElfSource &source);
+    void loadSections(ElfSource &source);
     void allocateAddressSpace();
-    void loadSegment(const Elf64_Phdr &header, std::istream &is);
+    void findDeferredSymbolTables();
+    bool isDeferredSymbolTable(Elf64_Half index) const;
+    void loadDeferredSymbolTables() const;
+    // Maps the segment's file contents or adds a request to read them
+    void planSegment(const Elf64_Phdr &header, ElfSource &source, std::vector<ElfReadRequest> &requests);
+    void clearSegmentTail(const Elf64_Phdr &header);
+    // Adds a request for every section outside of the segments `loadSections` is going to need
+    void planSections(std::vector<ElfReadRequest> &requests, std::vector<Elf64_Half> &sections) const;
+    // Only reads the notes so a hit never has to read the segments
+    uint64_t computeCacheKey(ElfSource &source) const;
+
+    std::shared_ptr<const char[]> loadSection(Elf64_Half index, ElfSource &source);
+    std::unique_ptr<const ElfRelocations> loadRelocations(Elf64_Half section_index, ElfSource &source);
+    const ElfSymbolTable loadSymbolTable(Elf64_Half symbol_index, ElfSource &source);
+    const Elf64_Sym *findSymbol(
+        Elf64_Half section_index, const ElfSymbolTable &table, const char *name, uint32_t gnu_hash
+    ) const;
+    const void *findSymbolAddress(
+        const std::map<Elf64_Half, const ElfSymbolTable> &tables, const char *name, uint32_t gnu_hash
+    ) const;
 
-    std::shared_ptr<const char[]> loadSection(Elf64_Half index, std::istream &is);
-    std::unique_ptr<const ElfRelocations> loadRelocations(Elf64_Half section_index, std::istream &is);
-    const ElfSymbolTable loadSymbolTable(Elf64_Half symbol_index, std::istream &is);
+    template <typename DataType>
+    DynamicArray<DataType> loadArray(Elf64_Half section_index, ElfSource &source);
 
     template <typename DataType>
-    DynamicArray<DataType> loadArray(Elf64_Half section_index, std::istream &is);
+    static DynamicArray<const DataType> loadTable(const ElfReadRequest &request, size_t count);
+
+    std::unique_ptr<ElfLoadStats> load_stats;
 
     Elf64_Ehdr elf_header;
     DynamicArray<const Elf64_Shdr> section_headers;
     DynamicArray<const Elf64_Phdr> program_headers;
     std::shared_ptr<const char[]> section_strings;
     std::shared_ptr<char[]> image_base;
+    size_t image_size;
+
+    uint64_t cache_key = 0;
+    bool restored_from_cache = false;
+    std::vector<ElfSymbolFixup> cached_symbol_fixups;
 
-    std::map<Elf64_Half, std::shared_ptr<char[]>> aux_sections;
+    std::map<Elf64_Half, std::shared_ptr<const char[]>> aux_sections;
 
     std::map<Elf64_Half, const ElfSymbolTable> symbol_tables;
 
+    // Keyed by the index of the symbol table they cover
+    std::map<Elf64_Half, const ElfGnuHashTable> gnu_hash_tables;
+    std::map<Elf64_Half, const ElfSysvHashTable> sysv_hash_tables;
+
     std::map<Elf64_Half, std::unique_ptr<const ElfRelocations>> relocations;
+    std::map<Elf64_Half, const DynamicArray<const Elf64_Relr>> packed_relocations;
 
     std::map<Elf64_Half, const DynamicArray<const ElfFunction>> init_array;
     std::map<Elf64_Half, const DynamicArray<const ElfFunction>> fini_array;
 
     std::map<Elf64_Half, const DynamicArray<const Elf64_Dyn>> dynamic;
+
+    // Symbol tables `lazy_sections` left out of `symbol_tables` and the source to read them from
+    std::vector<Elf64_Half> deferred_symbol_tables;
+    mutable std::shared_ptr<ElfSource> deferred_source;
+    mutable std::once_flag deferred_tables_loaded;
+    // `symbol_tables` plus the deferred ones once they're read
+    mutable std::map<Elf64_Half, const ElfSymbolTable> all_symbol_tables;
+
+    mutable std::once_flag address_index_built;
+    mutable std::unique_ptr<const ElfAddressIndex> address_index;
 };
 
 void dumpElfHeader(const Elf64_Ehdr header, std::ostream &os);
@@ -94,5 +208,6 @@ void dumpFunctionArray(
     const std::string &name, const DynamicArray<const ElfFunction> array, std::ostream &os
 );
 void dumpDynamicEntry(const Elf64_Dyn entry, std::ostream &os);
+void dumpPackedRelocations(const DynamicArray<const Elf64_Relr> entries, std::ostream &os);
 
 #endif//__INC_ELF_IMAGE_H_
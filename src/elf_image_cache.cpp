@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "exceptions.h"
+#include "elf_source.h"
+#include "elf_image_cache.h"
+using namespace std;
+
+static const char cache_magic[8] = {'E', 'L', 'F', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t cache_version = 2;
+
+// Everything in the file is 8 byte words so the layout is the same for any compiler
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t range_count;
+    uint64_t key;
+    uint64_t image_base;
+    uint64_t fixup_count;
+    uint64_t fixup_offset;
+    // Followed by `names_size` bytes of NUL terminated names
+    uint64_t symbol_fixup_count;
+    uint64_t symbol_fixup_offset;
+    uint64_t names_size;
+};
+
+struct CacheSymbolFixup {
+    uint64_t image_offset;
+    int64_t addend;
+    uint64_t name_offset;
+};
+
+// Page aligned span of the image and where its bytes are in the file
+struct CacheRange {
+    uint64_t image_offset;
+    uint64_t size;
+    uint64_t file_offset;
+};
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    uint64_t hash = seed ^ (size * 0x9e3779b97f4a7c15);
+    for(; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+        hash ^= hash >> 32;
+    }
+    if(size) {
+        uint64_t word = 0;
+        memcpy(&word, bytes, size);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// Pages covered by PT_LOAD segments, merged where segments share or touch pages
+static vector<CacheRange> getImageRanges(const DynamicArray<const Elf64_Phdr> &program_headers) {
+    vector<CacheRange> ranges;
+    for(const Elf64_Phdr &header : program_headers) {
+        if(header.p_type == PT_LOAD) {
+            uint64_t start = pageFloor(header.p_vaddr);
+            ranges.push_back({start, pageCeil(header.p_vaddr + header.p_memsz) - start, 0});
+        }
+    }
+    sort(ranges.begin(), ranges.end(), [](const CacheRange &a, const CacheRange &b) {
+        return a.image_offset < b.image_offset;
+    });
+
+    vector<CacheRange> merged;
+    for(const CacheRange &range : ranges) {
+        if(!merged.empty() && merged.back().image_offset + merged.back().size >= range.image_offset) {
+            uint64_t end = max(merged.back().image_offset + merged.back().size, range.image_offset + range.size);
+            merged.back().size = end - merged.back().image_offset;
+        } else {
+            merged.push_back(range);
+        }
+    }
+
+    // The header and range table take up the first pages
+    uint64_t file_offset = pageCeil(sizeof(CacheHeader) + merged.size() * sizeof(CacheRange));
+    for(CacheRange &range : merged) {
+        range.file_offset = file_offset;
+        file_offset += range.size;
+    }
+    return merged;
+}
+
+// Whether the word at `image_offset` is entirely inside one of `ranges`
+static bool isInsideRanges(const vector<CacheRange> &ranges, uint64_t image_offset) {
+    for(const CacheRange &range : ranges) {
+        if(image_offset >= range.image_offset && image_offset - range.image_offset <= range.size - sizeof(uint64_t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool readAll(int fd, void *dest, size_t size, off_t offset) {
+    char *ptr = (char*)dest;
+    while(size) {
+        ssize_t count = pread(fd, ptr, size, offset);
+        if(count <= 0) {
+            return false;
+        }
+        ptr += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void *src, size_t size, off_t offset) {
+    const char *ptr = (const char*)src;
+    while(size) {
+        ssize_t count = pwrite(fd, ptr, size, offset);
+        if(count <= 0) {
+            return false;
+        }
+        ptr += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+ElfImageCache::ElfImageCache(const string &directory) : directory(directory) { }
+
+string ElfImageCache::getPath(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.elfcache", (unsigned long long)key);
+    return directory + "/" + name;
+}
+
+bool ElfImageCache::restore(
+    uint64_t key, char *image_base, const DynamicArray<const Elf64_Phdr> &program_headers, vector<ElfSymbolFixup> &symbol_fixups
+) const {
+    int fd = open(getPath(key).c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+
+    // Everything is validated before the first mapping since after that there's no going back
+    vector<CacheRange> ranges = getImageRanges(program_headers);
+    CacheHeader header;
+    vector<CacheRange> stored_ranges(ranges.size());
+    struct stat file_stat;
+    bool valid = readAll(fd, &header, sizeof(header), 0)
+        && !memcmp(header.magic, cache_magic, sizeof(cache_magic))
+        && header.version == cache_version
+        && header.key == key
+        && header.range_count == ranges.size()
+        && readAll(fd, stored_ranges.data(), ranges.size() * sizeof(CacheRange), sizeof(header))
+        && !fstat(fd, &file_stat);
+    // Mapping past the end of the file would only fault once the image is used
+    uint64_t file_size = valid ? file_stat.st_size : 0;
+    for(size_t i = 0; valid && i < ranges.size(); i++) {
+        valid = !memcmp(&ranges[i], &stored_ranges[i], sizeof(CacheRange))
+            && file_size >= ranges[i].file_offset + ranges[i].size;
+    }
+    // Counts are checked against what's left of the file so a corrupt one can't overflow or exhaust memory
+    valid = valid
+        && header.fixup_offset <= file_size
+        && header.fixup_count <= (file_size - header.fixup_offset) / sizeof(Elf64_Addr)
+        && header.symbol_fixup_offset <= file_size
+        && header.symbol_fixup_count <= (file_size - header.symbol_fixup_offset) / sizeof(CacheSymbolFixup)
+        && header.names_size
+            <= file_size - header.symbol_fixup_offset - header.symbol_fixup_count * sizeof(CacheSymbolFixup);
+
+    vector<Elf64_Addr> fixups(valid ? header.fixup_count : 0);
+    vector<CacheSymbolFixup> stored_symbol_fixups(valid ? header.symbol_fixup_count : 0);
+    vector<char> names(valid ? header.names_size : 0);
+    valid = valid
+        && readAll(fd, fixups.data(), fixups.size() * sizeof(Elf64_Addr), header.fixup_offset)
+        && readAll(
+            fd, stored_symbol_fixups.data(), stored_symbol_fixups.size() * sizeof(CacheSymbolFixup), header.symbol_fixup_offset
+        )
+        && readAll(
+            fd, names.data(), names.size(), header.symbol_fixup_offset + stored_symbol_fixups.size() * sizeof(CacheSymbolFixup)
+        );
+    // Every word written after mapping has to be inside the mapped ranges
+    for(size_t i = 0; valid && i < fixups.size(); i++) {
+        valid = isInsideRanges(ranges, fixups[i]);
+    }
+    // Symbol slots too, and their names have to end inside the table
+    for(size_t i = 0; valid && i < stored_symbol_fixups.size(); i++) {
+        uint64_t name_offset = stored_symbol_fixups[i].name_offset;
+        valid = isInsideRanges(ranges, stored_symbol_fixups[i].image_offset)
+            && name_offset < names.size() && memchr(&names[name_offset], 0, names.size() - name_offset);
+    }
+    if(!valid) {
+        close(fd);
+        return false;
+    }
+
+    for(const CacheRange &range : ranges) {
+        void *ptr = mmap(
+            image_base + range.image_offset,
+            range.size,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_FIXED,
+            fd,
+            range.file_offset
+        );
+        if(ptr == MAP_FAILED) {
+            close(fd);
+            throw FileAccessError();
+        }
+    }
+    close(fd);
+
+    // Values that pointed into the image were written for the base it had when it was stored
+    Elf64_Xword delta = (Elf64_Xword)image_base - header.image_base;
+    if(delta) {
+        for(Elf64_Addr fixup : fixups) {
+            *(Elf64_Xword*)(image_base + fixup) += delta;
+        }
+    }
+
+    symbol_fixups.clear();
+    symbol_fixups.reserve(stored_symbol_fixups.size());
+    for(const CacheSymbolFixup &fixup : stored_symbol_fixups) {
+        symbol_fixups.push_back({fixup.image_offset, &names[fixup.name_offset], fixup.addend});
+    }
+    return true;
+}
+
+void ElfImageCache::store(
+    uint64_t key,
+    const char *image_base,
+    const DynamicArray<const Elf64_Phdr> &program_headers,
+    const vector<Elf64_Addr> &fixups,
+    const vector<ElfSymbolFixup> &symbol_fixups
+) const {
+    vector<CacheRange> ranges = getImageRanges(program_headers);
+    uint64_t fixup_offset = ranges.empty()
+        ? pageCeil(sizeof(CacheHeader))
+        : ranges.back().file_offset + ranges.back().size;
+    uint64_t symbol_fixup_offset = fixup_offset + fixups.size() * sizeof(Elf64_Addr);
+
+    vector<CacheSymbolFixup> stored_symbol_fixups;
+    string names;
+    stored_symbol_fixups.reserve(symbol_fixups.size());
+    for(const ElfSymbolFixup &fixup : symbol_fixups) {
+        stored_symbol_fixups.push_back({fixup.offset, fixup.addend, names.size()});
+        names += fixup.name;
+        names += '\0';
+    }
+
+    CacheHeader header;
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.range_count = ranges.size();
+    header.key = key;
+    header.image_base = (uint64_t)image_base;
+    header.fixup_count = fixups.size();
+    header.fixup_offset = fixup_offset;
+    header.symbol_fixup_count = stored_symbol_fixups.size();
+    header.symbol_fixup_offset = symbol_fixup_offset;
+    header.names_size = names.size();
+
+    // Written under a unique name and renamed so readers never see a partial entry
+    // The name is unique per call, threads of one process store the same key at the same time too
+    string path = getPath(key);
+    string temp_path = path + ".XXXXXX";
+    int fd = mkostemp(&temp_path[0], O_CLOEXEC);
+    if(fd < 0) {
+        return;
+    }
+    // mkostemp creates the file private to this user, entries are meant to be shared like any other cache file
+    if(fchmod(fd, 0644)) {
+        close(fd);
+        unlink(temp_path.c_str());
+        return;
+    }
+
+    bool written = writeAll(fd, &header, sizeof(header), 0)
+        && writeAll(fd, ranges.data(), ranges.size() * sizeof(CacheRange), sizeof(header));
+    for(size_t i = 0; written && i < ranges.size(); i++) {
+        written = writeAll(fd, image_base + ranges[i].image_offset, ranges[i].size, ranges[i].file_offset);
+    }
+    written = written
+        && writeAll(fd, fixups.data(), fixups.size() * sizeof(Elf64_Addr), fixup_offset)
+        && writeAll(
+            fd, stored_symbol_fixups.data(), stored_symbol_fixups.size() * sizeof(CacheSymbolFixup), symbol_fixup_offset
+        )
+        && writeAll(fd, names.data(), names.size(), symbol_fixup_offset + stored_symbol_fixups.size() * sizeof(CacheSymbolFixup));
+    close(fd);
+
+    if(!written || rename(temp_path.c_str(), path.c_str())) {
+        unlink(temp_path.c_str());
+    }
+}
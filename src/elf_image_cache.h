@@ -0,0 +1,50 @@
+#ifndef __INC_ELF_IMAGE_CACHE_H_
+#define __INC_ELF_IMAGE_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "elf64.h"
+#include "dynamic_array.h"
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed);
+
+// An image offset holding a symbol's address plus `addend`, resolved again on every restore
+struct ElfSymbolFixup {
+    Elf64_Addr offset;
+    std::string name;
+    Elf64_Sxword addend;
+};
+
+// Fully relocated images saved to disk so a later load is a mapping plus rebasing
+// Entries are named by a key identifying the file's contents, every symbol is resolved again on restore
+class ElfImageCache {
+public:
+    ElfImageCache(const std::string &directory);
+
+    // Maps a stored image over the segments and rebases it, returns false when there's no usable entry
+    // The caller has to write the resolved `symbol_fixups` before the image is used
+    bool restore(
+        uint64_t key,
+        char *image_base,
+        const DynamicArray<const Elf64_Phdr> &program_headers,
+        std::vector<ElfSymbolFixup> &symbol_fixups
+    ) const;
+
+    // `fixups` are the image offsets holding values relative to the image base
+    // This is best effort, if it fails the next load just misses
+    void store(
+        uint64_t key,
+        const char *image_base,
+        const DynamicArray<const Elf64_Phdr> &program_headers,
+        const std::vector<Elf64_Addr> &fixups,
+        const std::vector<ElfSymbolFixup> &symbol_fixups
+    ) const;
+
+private:
+    std::string getPath(uint64_t key) const;
+
+    std::string directory;
+};
+
+#endif//__INC_ELF_IMAGE_CACHE_H_
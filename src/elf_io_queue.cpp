@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <future>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "exceptions.h"
+#include "elf_io_queue.h"
+using namespace std;
+
+shared_ptr<ElfIoQueue> ElfIoQueue::create(unsigned threads) {
+    try {
+        return make_shared<ElfUringQueue>();
+    } catch(const AsyncIoUnavailable&) {
+        return make_shared<ElfThreadedQueue>(threads);
+    }
+}
+
+static int enterRing(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+ElfUringQueue::ElfUringQueue(unsigned entries)
+    : sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sqes((struct io_uring_sqe*)MAP_FAILED), in_flight(0), reaping(false), broken(false) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(ring_fd < 0) {
+        throw AsyncIoUnavailable();
+    }
+
+    // Newer kernels put both rings in one mapping
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap) {
+        sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+    }
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if(sq_ring != MAP_FAILED) {
+        cq_ring = single_mmap ? sq_ring : mmap(
+            nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING
+        );
+    }
+    if(cq_ring != MAP_FAILED) {
+        sqes = (struct io_uring_sqe*)mmap(
+            nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES
+        );
+    }
+    if(sqes == MAP_FAILED) {
+        unmapRing();
+        close(ring_fd);
+        throw AsyncIoUnavailable();
+    }
+
+    char *sq = (char*)sq_ring;
+    sq_head = (unsigned*)&sq[params.sq_off.head];
+    sq_tail = (unsigned*)&sq[params.sq_off.tail];
+    sq_mask = *(unsigned*)&sq[params.sq_off.ring_mask];
+    sq_array = (unsigned*)&sq[params.sq_off.array];
+    sq_entries = params.sq_entries;
+
+    char *cq = (char*)cq_ring;
+    cq_head = (unsigned*)&cq[params.cq_off.head];
+    cq_tail = (unsigned*)&cq[params.cq_off.tail];
+    cq_mask = *(unsigned*)&cq[params.cq_off.ring_mask];
+    cqes = (struct io_uring_cqe*)&cq[params.cq_off.cqes];
+    cq_entries = params.cq_entries;
+}
+
+ElfUringQueue::~ElfUringQueue() {
+    unmapRing();
+    close(ring_fd);
+}
+
+void ElfUringQueue::unmapRing() {
+    if(sqes != MAP_FAILED) {
+        munmap(sqes, sqes_size);
+    }
+    if(cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if(sq_ring != MAP_FAILED) {
+        munmap(sq_ring, sq_ring_size);
+    }
+}
+
+static void skipEmptyBuffers(const vector<struct iovec> &buffers, size_t &next) {
+    while(next < buffers.size() && !buffers[next].iov_len) {
+        next++;
+    }
+}
+
+void ElfUringQueue::read(int fd, const vector<ElfScatteredRead> &reads) {
+    Batch batch = {0, false, false};
+    vector<Operation> operations;
+    operations.reserve(reads.size());
+    for(const ElfScatteredRead &read : reads) {
+        operations.push_back({&batch, fd, read.offset, read.buffers, 0});
+        skipEmptyBuffers(operations.back().buffers, operations.back().next);
+    }
+
+    unique_lock<mutex> lock(ring_mutex);
+    if(broken) {
+        throw FileAccessError();
+    }
+    batches.push_back(&batch);
+    for(Operation &operation : operations) {
+        if(operation.next < operation.buffers.size()) {
+            waiting.push_back(&operation);
+            batch.pending++;
+        }
+    }
+    submitWaiting();
+
+    // One caller at a time waits in the kernel and hands out everyone's completions
+    // The operations live on this stack so nothing can leave until its own are done, even after a failure
+    // A ring which can't be entered any more is the exception, nothing would ever be done then
+    while(batch.pending) {
+        if(reaping) {
+            completed.wait(lock);
+            continue;
+        }
+
+        reaping = true;
+        unsigned to_submit = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        lock.unlock();
+        int result = enterRing(ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        int error = errno;
+        lock.lock();
+        reaping = false;
+
+        // Interrupted or short of resources just means trying again, anything else won't get better
+        if(result < 0 && error != EINTR && error != EAGAIN && error != EBUSY) {
+            failAll();
+        } else {
+            reapCompletions();
+            submitWaiting();
+        }
+        completed.notify_all();
+    }
+    batches.erase(find(batches.begin(), batches.end(), &batch));
+
+    if(batch.failed) {
+        throw FileAccessError();
+    }
+    if(batch.truncated) {
+        throw TruncatedFile();
+    }
+}
+
+void ElfUringQueue::failAll() {
+    // Nothing is reaped after this, operations the kernel already took are abandoned along with the rest
+    broken = true;
+    waiting.clear();
+    in_flight = 0;
+    for(Batch *batch : batches) {
+        batch->failed = true;
+        batch->pending = 0;
+    }
+}
+
+void ElfUringQueue::submitWaiting() {
+    unsigned tail = *sq_tail;
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+    // Never more in flight than the completion ring holds so it can't overflow
+    while(!waiting.empty() && in_flight < cq_entries && tail - head < sq_entries) {
+        Operation *operation = waiting.front();
+        waiting.pop_front();
+
+        unsigned index = tail & sq_mask;
+        struct io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = operation->fd;
+        sqe.off = operation->offset;
+        sqe.addr = (uint64_t)&operation->buffers[operation->next];
+        sqe.len = min(operation->buffers.size() - operation->next, (size_t)IOV_MAX);
+        sqe.user_data = (uint64_t)operation;
+        sq_array[index] = index;
+
+        tail++;
+        in_flight++;
+    }
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+    // Whatever the kernel doesn't take now goes with the next reap
+    if(tail != head) {
+        while(enterRing(ring_fd, tail - head, 0, 0) < 0 && errno == EINTR) { }
+    }
+}
+
+void ElfUringQueue::reapCompletions() {
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++) {
+        const struct io_uring_cqe &cqe = cqes[head & cq_mask];
+        in_flight--;
+        complete((Operation*)cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+void ElfUringQueue::complete(Operation *operation, int32_t result) {
+    if(result == -EINTR || result == -EAGAIN) {
+        waiting.push_back(operation);
+        return;
+    }
+
+    if(result < 0) {
+        operation->batch->failed = true;
+    } else if(!result) {
+        operation->batch->truncated = true;
+    } else {
+        // Short reads can stop anywhere, even inside a buffer, the rest goes back in the queue
+        operation->offset += result;
+        for(size_t done = result; done;) {
+            struct iovec &buffer = operation->buffers[operation->next];
+            size_t step = min(done, buffer.iov_len);
+            buffer.iov_base = (char*)buffer.iov_base + step;
+            buffer.iov_len -= step;
+            done -= step;
+            skipEmptyBuffers(operation->buffers, operation->next);
+        }
+        if(operation->next < operation->buffers.size()) {
+            waiting.push_back(operation);
+            return;
+        }
+    }
+    operation->batch->pending--;
+}
+
+ElfThreadedQueue::ElfThreadedQueue(unsigned threads) : pool(threads) { }
+
+void ElfThreadedQueue::read(int fd, const vector<ElfScatteredRead> &reads) {
+    if(reads.size() == 1) {
+        readFileScattered(fd, reads[0].offset, reads[0].buffers.data(), reads[0].buffers.size());
+        return;
+    }
+
+    vector<future<void>> done;
+    for(const ElfScatteredRead &read : reads) {
+        done.push_back(pool.submit([fd, &read]() {
+            readFileScattered(fd, read.offset, read.buffers.data(), read.buffers.size());
+        }));
+    }
+
+    // Every read has to finish before the buffers can go away
+    exception_ptr error;
+    for(future<void> &result : done) {
+        try {
+            result.get();
+        } catch(...) {
+            if(!error) {
+                error = current_exception();
+            }
+        }
+    }
+    if(error) {
+        rethrow_exception(error);
+    }
+}
+
+ElfQueuedSource::ElfQueuedSource(const string &path, shared_ptr<ElfIoQueue> queue) : queue(queue) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw FileAccessError();
+    }
+}
+
+ElfQueuedSource::ElfQueuedSource(int fd, shared_ptr<ElfIoQueue> queue) : queue(queue) {
+    // The caller keeps ownership of their descriptor
+    this->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if(this->fd < 0) {
+        throw FileAccessError();
+    }
+}
+
+ElfQueuedSource::~ElfQueuedSource() {
+    close(fd);
+}
+
+void ElfQueuedSource::read(Elf64_Off offset, size_t size, void *dest) {
+    struct iovec buffer = {dest, size};
+    readScattered(offset, &buffer, 1);
+}
+
+void ElfQueuedSource::readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count) {
+    queue->read(fd, {ElfScatteredRead{offset, vector<struct iovec>(buffers, buffers + count)}});
+}
+
+void ElfQueuedSource::readScatteredBatch(const vector<ElfScatteredRead> &reads) {
+    queue->read(fd, reads);
+}
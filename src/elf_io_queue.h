@@ -0,0 +1,116 @@
+#ifndef __INC_ELF_IO_QUEUE_H_
+#define __INC_ELF_IO_QUEUE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "elf_source.h"
+#include "thread_pool.h"
+
+// Somewhere many threads can hand reads to at once so reads for different images overlap
+class ElfIoQueue {
+public:
+    virtual ~ElfIoQueue() { }
+
+    // Performs every read on `fd` and returns once they're all done
+    virtual void read(int fd, const std::vector<ElfScatteredRead> &reads) = 0;
+
+    // io_uring when the kernel allows it, otherwise `threads` workers calling preadv
+    static std::shared_ptr<ElfIoQueue> create(unsigned threads = 4);
+};
+
+// One ring shared by every caller, whichever caller is waiting reaps completions for all of them
+class ElfUringQueue : public ElfIoQueue {
+public:
+    // Throws AsyncIoUnavailable when the kernel doesn't support io_uring or has it turned off
+    ElfUringQueue(unsigned entries = 256);
+    ~ElfUringQueue();
+
+    void read(int fd, const std::vector<ElfScatteredRead> &reads);
+
+private:
+    struct Batch {
+        size_t pending;
+        bool failed;
+        bool truncated;
+    };
+
+    struct Operation {
+        Batch *batch;
+        int fd;
+        uint64_t offset;
+        std::vector<struct iovec> buffers;
+        size_t next;
+    };
+
+    void unmapRing();
+    void submitWaiting();
+    void reapCompletions();
+    void complete(Operation *operation, int32_t result);
+    // Gives up on every read once the ring can't be entered any more
+    void failAll();
+
+    int ring_fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned cq_entries;
+
+    // Everything below is guarded by `ring_mutex`
+    std::mutex ring_mutex;
+    std::condition_variable completed;
+    std::deque<Operation*> waiting;
+    // Every caller's batch so a failure can reach the ones whose operations are in flight
+    std::vector<Batch*> batches;
+    unsigned in_flight;
+    bool reaping;
+    // Set by `failAll`, later reads fail straight away
+    bool broken;
+};
+
+// Fallback for kernels without io_uring, reads are spread over a pool of workers
+class ElfThreadedQueue : public ElfIoQueue {
+public:
+    ElfThreadedQueue(unsigned threads);
+
+    void read(int fd, const std::vector<ElfScatteredRead> &reads);
+
+private:
+    ThreadPool pool;
+};
+
+// Sends every read through an ElfIoQueue, nothing is mapped
+class ElfQueuedSource : public ElfSource {
+public:
+    ElfQueuedSource(const std::string &path, std::shared_ptr<ElfIoQueue> queue);
+    ElfQueuedSource(int fd, std::shared_ptr<ElfIoQueue> queue);
+    ~ElfQueuedSource();
+
+    void read(Elf64_Off offset, size_t size, void *dest);
+    void readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count);
+    void readScatteredBatch(const std::vector<ElfScatteredRead> &reads);
+    int getFileDescriptor() const { return fd; }
+
+private:
+    int fd;
+    std::shared_ptr<ElfIoQueue> queue;
+};
+
+#endif//__INC_ELF_IO_QUEUE_H_
@@ -0,0 +1,105 @@
+#include <cpuid.h>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include "elf_lazy_binding.h"
+#include "elf_module.h"
+using namespace std;
+
+// Filled in by elfPrepareLazyBinding before any slot can reach the trampoline
+extern "C" {
+    __attribute__((visibility("hidden"))) size_t elfLazyBindingFrameSize = 0;
+    __attribute__((visibility("hidden"))) bool elfLazyBindingUseXsave = false;
+}
+
+// Stack on entry: [rsp] module (GOT[1]), [rsp + 8] relocation index, [rsp + 16] caller's return address
+// The frame is 64 byte aligned and holds the integer argument registers followed by the vector state
+// The binder runs string and hashing code which may use AVX, so saving xmm0-7 alone would lose the upper halves of
+// ymm/zmm arguments, xsave saves whatever the OS has enabled like ld.so's own resolver does
+// Components saved are SSE, AVX and the three AVX-512 ones, CPUs without xsave fall back to fxsave
+asm(R"(
+    .pushsection .text
+    .globl elfLazyBindingTrampoline
+    .type elfLazyBindingTrampoline, @function
+elfLazyBindingTrampoline:
+    push %rbx
+    mov %rsp, %rbx
+    and $-64, %rsp
+    sub elfLazyBindingFrameSize(%rip), %rsp
+    mov %rax, 0(%rsp)
+    mov %rcx, 8(%rsp)
+    mov %rdx, 16(%rsp)
+    mov %rsi, 24(%rsp)
+    mov %rdi, 32(%rsp)
+    mov %r8, 40(%rsp)
+    mov %r9, 48(%rsp)
+    cmpb $0, elfLazyBindingUseXsave(%rip)
+    je 1f
+    mov $0xe6, %eax
+    xor %edx, %edx
+    mov %rdx, 576(%rsp)
+    mov %rdx, 584(%rsp)
+    mov %rdx, 592(%rsp)
+    mov %rdx, 600(%rsp)
+    mov %rdx, 608(%rsp)
+    mov %rdx, 616(%rsp)
+    mov %rdx, 624(%rsp)
+    mov %rdx, 632(%rsp)
+    xsave 64(%rsp)
+    jmp 2f
+1:
+    fxsave 64(%rsp)
+2:
+    mov 8(%rbx), %rdi
+    mov 16(%rbx), %rsi
+    call elfBindLazySymbol
+    mov %rax, %r11
+    cmpb $0, elfLazyBindingUseXsave(%rip)
+    je 3f
+    mov $0xe6, %eax
+    xor %edx, %edx
+    xrstor 64(%rsp)
+    jmp 4f
+3:
+    fxrstor 64(%rsp)
+4:
+    mov 0(%rsp), %rax
+    mov 8(%rsp), %rcx
+    mov 16(%rsp), %rdx
+    mov 24(%rsp), %rsi
+    mov 32(%rsp), %rdi
+    mov 40(%rsp), %r8
+    mov 48(%rsp), %r9
+    mov %rbx, %rsp
+    pop %rbx
+    add $16, %rsp
+    jmp *%r11
+    .size elfLazyBindingTrampoline, .-elfLazyBindingTrampoline
+    .popsection
+)");
+
+void elfPrepareLazyBinding() {
+    static once_flag prepared;
+    call_once(prepared, []() {
+        // Integer registers take the first 64 bytes, the save area follows
+        size_t state_size = 512;
+        unsigned eax, ebx, ecx, edx;
+        if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_OSXSAVE)) {
+            // EBX of leaf 0xD covers every component the OS enabled in XCR0
+            __cpuid_count(0xd, 0, eax, ebx, ecx, edx);
+            state_size = ebx;
+            elfLazyBindingUseXsave = true;
+        }
+        elfLazyBindingFrameSize = (64 + state_size + 63) / 64 * 64;
+    });
+}
+
+const void *elfBindLazySymbol(ElfModule *module, Elf64_Xword relocation_index) {
+    // There's no unwind information through the trampoline so exceptions can't leave here
+    try {
+        return module->bindLazySymbol(relocation_index);
+    } catch(const exception &e) {
+        cerr << "Lazy binding failed: " << e.what() << endl;
+        abort();
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef __INC_ELF_LAZY_BINDING_H_
+#define __INC_ELF_LAZY_BINDING_H_
+
+#include "elf64.h"
+
+class ElfModule;
+
+// PLT0 jumps here through GOT[2] with GOT[1] and the PLT relocation index pushed on the stack
+// It saves the argument registers and vector state, binds the slot and tail calls the real function
+extern "C" void elfLazyBindingTrampoline();
+
+// Sizes the trampoline's save area for this CPU, has to run before GOT[2] points at the trampoline
+void elfPrepareLazyBinding();
+
+// Called by the trampoline, returns the address the slot now points at
+extern "C" const void *elfBindLazySymbol(ElfModule *module, Elf64_Xword relocation_index);
+
+#endif//__INC_ELF_LAZY_BINDING_H_
@@ -0,0 +1,48 @@
+#ifndef __INC_ELF_LOAD_OPTIONS_H_
+#define __INC_ELF_LOAD_OPTIONS_H_
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include "elf_load_stats.h"
+
+class ElfCancelToken;
+class ElfIoQueue;
+
+struct ElfLoadOptions {
+    // Images opened by path or descriptor are mapped and served from the mapping
+    // Otherwise they're read with a few large preads, which can be cheaper when faulting pages in is slow
+    bool map_file = true;
+    // When set, images opened by path or descriptor read through this instead and `map_file` is ignored
+    // Share one between images loaded together so their reads are in flight at the same time
+    std::shared_ptr<ElfIoQueue> io_queue;
+    // Threads relocations are applied on, 1 applies them on the loading thread
+    unsigned relocation_threads = 1;
+    // Relocations handed to a worker at a time
+    size_t relocation_chunk_size = 16384;
+    // Resolve PLT slots on their first call instead of at load time
+    // Modules linked with -z now are always bound eagerly
+    bool lazy_binding = false;
+    // Directory relocated images are saved to and restored from, empty disables the cache
+    // Lazily bound modules are never cached since their GOT points back at this process
+    // Entries are looked up before the segments are read, only modules should set this since a bare ElfImage restored
+    // from an entry is left with the storing process's symbol addresses
+    std::string cache_directory;
+    // Append the module's functions to /tmp/perf-<pid>.map once it's relocated so perf can symbolize them
+    bool perf_map = false;
+    // Fill in ElfImage::getLoadStats, turned on by `stats_callback` as well
+    bool collect_stats = false;
+    // Called with the stats once a module is relocated
+    std::function<void(const ElfLoadStats&)> stats_callback;
+    // Stop after mapping, whoever built the module calls ElfModule::relocate later
+    bool defer_relocation = false;
+    // Keep .symtab out of memory until a lookup misses every other table, the image is dumped or the tables are walked
+    // Relocation tables are dropped once applied, apart from .rela.plt while lazy binding still needs it
+    // Images read from a stream load everything up front since the stream can't be held on to
+    bool lazy_sections = false;
+    // Checked between load phases, cancelling it makes the load throw LoadCancelled
+    std::shared_ptr<ElfCancelToken> cancel_token;
+};
+
+#endif//__INC_ELF_LOAD_OPTIONS_H_
@@ -0,0 +1,65 @@
+#ifndef __INC_ELF_LOAD_STATS_H_
+#define __INC_ELF_LOAD_STATS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include "elf64.h"
+
+// Where a load spent its time, only filled in when ElfLoadOptions asks for it
+struct ElfLoadStats {
+    // Against the file, views served from a mapping or buffer copy nothing
+    uint64_t bytes_read = 0;
+    uint64_t bytes_viewed = 0;
+    uint64_t bytes_mapped = 0;
+    uint64_t reads = 0;
+    // Reads which didn't continue where the previous one stopped
+    uint64_t seeks = 0;
+
+    // ElfImage
+    uint64_t header_nanoseconds = 0;
+    uint64_t address_space_nanoseconds = 0;
+    // Mapping segments and clearing their .bss
+    uint64_t segment_nanoseconds = 0;
+    // The batch of segment contents and sections which couldn't be mapped or viewed
+    uint64_t read_nanoseconds = 0;
+    // Every section read after the segments, including the symbol tables
+    uint64_t section_nanoseconds = 0;
+    uint64_t symbol_table_nanoseconds = 0;
+
+    // ElfModule
+    uint64_t packed_relocation_nanoseconds = 0;
+    uint64_t relative_relocation_nanoseconds = 0;
+    uint64_t symbol_resolution_nanoseconds = 0;
+    uint64_t symbol_relocation_nanoseconds = 0;
+    uint64_t cache_nanoseconds = 0;
+    uint64_t protection_nanoseconds = 0;
+
+    // Keyed by relocation type, packed relocations count as R_X86_64_RELATIVE
+    std::map<Elf64_Xword, uint64_t> relocation_counts;
+    uint64_t symbol_lookups = 0;
+};
+
+// Adds the time until it goes out of scope to one of the fields, null stats make it do nothing
+class ElfStatsTimer {
+public:
+    ElfStatsTimer(ElfLoadStats *stats, uint64_t ElfLoadStats::*field) : nanoseconds(stats ? &(stats->*field) : nullptr) {
+        if(nanoseconds) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ElfStatsTimer() {
+        if(nanoseconds) {
+            *nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start
+            ).count();
+        }
+    }
+
+private:
+    uint64_t *nanoseconds;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif//__INC_ELF_LOAD_STATS_H_
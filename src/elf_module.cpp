@@ -1,29 +1,486 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
 #include "exceptions.h"
 #include "elf_module.h"
+#include "elf_cancel_token.h"
 #include "elf_decoding.h"
+#include "elf_image_cache.h"
+#include "elf_lazy_binding.h"
+#include "thread_pool.h"
 using namespace std;
 
-ElfModule::ElfModule(const DynamicShims &shims, std::istream &is) : ElfImage(is), shims(shims) {
-    processRelocations();
+ElfModule::ElfModule(const DynamicShims &shims, std::istream &is, const ElfLoadOptions &options)
+    : ElfImage(is, options), scope(make_shared<ElfSymbolScope>(shims)), options(options) {
+    scope->addImage(this);
+    if(!options.defer_relocation) {
+        relocate();
+    }
+}
+
+ElfModule::ElfModule(const DynamicShims &shims, const std::string &path, const ElfLoadOptions &options)
+    : ElfImage(path, options), scope(make_shared<ElfSymbolScope>(shims)), options(options) {
+    scope->addImage(this);
+    if(!options.defer_relocation) {
+        relocate();
+    }
+}
+
+ElfModule::ElfModule(const DynamicShims &shims, int fd, const ElfLoadOptions &options)
+    : ElfImage(fd, options), scope(make_shared<ElfSymbolScope>(shims)), options(options) {
+    scope->addImage(this);
+    if(!options.defer_relocation) {
+        relocate();
+    }
+}
+
+ElfModule::ElfModule(
+    const DynamicShims &shims, shared_ptr<const char[]> buffer, size_t size, const ElfLoadOptions &options
+) : ElfImage(buffer, size, options), scope(make_shared<ElfSymbolScope>(shims)), options(options) {
+    scope->addImage(this);
+    if(!options.defer_relocation) {
+        relocate();
+    }
+}
+
+ElfModule::ElfModule(const DynamicShims &shims, const void *buffer, size_t size, const ElfLoadOptions &options)
+    : ElfImage(buffer, size, options), scope(make_shared<ElfSymbolScope>(shims)), options(options) {
+    scope->addImage(this);
+    if(!options.defer_relocation) {
+        relocate();
+    }
+}
+
+void ElfModule::relocate() {
+    if(relocated) {
+        return;
+    }
+    checkCancelled(options.cancel_token);
+    relocated = true;
+
+    ElfLoadStats *stats = getWritableLoadStats();
+    if(isRestoredFromCache()) {
+        // Other images are wherever this process put them so their addresses are looked up again
+        ElfStatsTimer timer(stats, &ElfLoadStats::symbol_resolution_nanoseconds);
+        for(const ElfSymbolFixup &fixup : takeCachedSymbolFixups()) {
+            Elf64_Xword *dest = (Elf64_Xword*)((char*)getImageBase() + fixup.offset);
+            *dest = (Elf64_Xword)getShim(fixup.name.c_str()) + fixup.addend;
+        }
+    } else {
+        processRelocations();
+        if(getCacheKey()) {
+            ElfStatsTimer timer(stats, &ElfLoadStats::cache_nanoseconds);
+            vector<Elf64_Addr> fixups;
+            vector<ElfSymbolFixup> symbol_fixups;
+            collectFixups(fixups, symbol_fixups);
+            ElfImageCache(options.cache_directory).store(
+                getCacheKey(), (const char*)getImageBase(), getProgramHeaders(), fixups, symbol_fixups
+            );
+        }
+    }
+    if(options.lazy_sections) {
+        releaseRelocations(plt_relocations);
+    }
+    {
+        ElfStatsTimer timer(stats, &ElfLoadStats::protection_nanoseconds);
+        protectSegments();
+    }
+
+    if(options.perf_map) {
+        writePerfMap();
+    }
+    if(options.stats_callback) {
+        options.stats_callback(*stats);
+    }
+}
+
+void ElfModule::writePerfMap() const {
+    // .dynsym and .symtab repeat each other, one line per address is enough
+    map<Elf64_Addr, pair<Elf64_Xword, const char*>> functions;
+    for(const auto &iterator : getSymbolTables()) {
+        const ElfSymbolTable &table = iterator.second;
+        for(const Elf64_Sym &symbol : table.symbols) {
+            if(ELF64_ST_TYPE(symbol.st_info) == STT_FUNC && symbol.st_shndx != SHN_UNDEF && symbol.st_name) {
+                functions.emplace(symbol.st_value, make_pair(symbol.st_size, &table.strings[symbol.st_name]));
+            }
+        }
+    }
+
+    string lines;
+    char line_start[64];
+    for(const auto &function : functions) {
+        snprintf(
+            line_start, sizeof(line_start), "%lx %lx ",
+            (unsigned long)((char*)getImageBase() + function.first), (unsigned long)function.second.first
+        );
+        lines += line_start;
+        lines += function.second.second;
+        lines += '\n';
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        return;
+    }
+    // Appends of one write don't interleave with other modules writing theirs
+    for(size_t written = 0; written < lines.size();) {
+        ssize_t result = write(fd, lines.data() + written, lines.size() - written);
+        if(result <= 0) {
+            break;
+        }
+        written += result;
+    }
+    close(fd);
+}
+
+void ElfModule::initialize() {
+    const Elf64_Dyn *init = findDynamicEntry(DT_INIT);
+    if(init) {
+        ((ElfFunction)((char*)getImageBase() + init->d_un.d_ptr))();
+    }
+    for(const auto &iterator : getInitArrays()) {
+        for(ElfFunction function : iterator.second) {
+            function();
+        }
+    }
+    initialized = true;
+}
+
+void ElfModule::finalize() {
+    if(!initialized) {
+        return;
+    }
+    initialized = false;
+
+    const auto &fini_arrays = getFiniArrays();
+    for(auto iterator = fini_arrays.rbegin(); iterator != fini_arrays.rend(); iterator++) {
+        const DynamicArray<const ElfFunction> &functions = iterator->second;
+        for(size_t i = functions.getLength(); i > 0; i--) {
+            functions[i - 1]();
+        }
+    }
+    const Elf64_Dyn *fini = findDynamicEntry(DT_FINI);
+    if(fini) {
+        ((ElfFunction)((char*)getImageBase() + fini->d_un.d_ptr))();
+    }
+}
+
+void ElfModule::setSymbolScope(shared_ptr<ElfSymbolScope> scope) {
+    this->scope = scope;
+}
+
+void ElfModule::addDependency(shared_ptr<const ElfModule> dependency) {
+    dependencies.push_back(dependency);
+}
+
+void ElfModule::collectFixups(vector<Elf64_Addr> &fixups, vector<ElfSymbolFixup> &symbol_fixups) const {
+    for(const auto &iterator : getRelocations()) {
+        const ElfSymbolTable &symbols = iterator.second->symbols;
+        for(const Elf64_Rela &relocation : iterator.second->relocations) {
+            Elf64_Xword type = ELF64_R_TYPE_ID(relocation.r_info);
+            Elf64_Xword symbol_index = ELF64_R_SYM(relocation.r_info);
+            switch(type) {
+            case R_X86_64_RELATIVE:
+                fixups.push_back(relocation.r_offset);
+                break;
+
+            case R_X86_64_64:
+                // Without a symbol the value is just the addend
+                if(!symbol_index) {
+                    break;
+                }
+                // Fall through
+            case R_X86_64_GLOB_DAT:
+            case R_X86_64_JMP_SLOT:
+                // Even symbols the scope resolved to this image are looked up again, it's all one path that way
+                symbol_fixups.push_back({
+                    relocation.r_offset,
+                    &symbols.strings[symbols.symbols[symbol_index].st_name],
+                    type == R_X86_64_64 ? relocation.r_addend : 0
+                });
+                break;
+            }
+        }
+    }
+
+    for(const auto &iterator : getPackedRelocations()) {
+        Elf64_Addr where = 0;
+        for(const Elf64_Relr entry : iterator.second) {
+            if(!(entry & 1)) {
+                where = entry;
+                fixups.push_back(where);
+                where += sizeof(Elf64_Xword);
+            } else {
+                for(Elf64_Relr bits = entry >> 1; bits; bits &= bits - 1) {
+                    fixups.push_back(where + __builtin_ctzll(bits) * sizeof(Elf64_Xword));
+                }
+                where += (sizeof(Elf64_Relr) * 8 - 1) * sizeof(Elf64_Xword);
+            }
+        }
+    }
+}
+
+typedef function<void(const Elf64_Rela *begin, const Elf64_Rela *end)> RelocationRangeFunction;
+
+// Runs `apply` over the range, split into chunks on the pool when there is one
+static void applyInChunks(
+    ThreadPool *pool, size_t chunk_size, const Elf64_Rela *begin, const Elf64_Rela *end, RelocationRangeFunction apply
+) {
+    if(!pool || (size_t)(end - begin) <= chunk_size) {
+        apply(begin, end);
+        return;
+    }
+
+    // Chunks write to disjoint GOT and data slots so they can be applied in any order
+    vector<future<void>> chunks;
+    for(const Elf64_Rela *chunk = begin; chunk < end; chunk += min(chunk_size, (size_t)(end - chunk))) {
+        const Elf64_Rela *chunk_end = chunk + min(chunk_size, (size_t)(end - chunk));
+        chunks.push_back(pool->submit([&apply, chunk, chunk_end]() {
+            apply(chunk, chunk_end);
+        }));
+    }
+
+    // Wait for everything before rethrowing so no worker outlives the caller's state
+    for(future<void> &chunk : chunks) {
+        chunk.wait();
+    }
+    for(future<void> &chunk : chunks) {
+        chunk.get();
+    }
 }
 
 void ElfModule::processRelocations() {
+    unique_ptr<ThreadPool> pool;
+    if(options.relocation_threads > 1) {
+        pool.reset(new ThreadPool(options.relocation_threads));
+    }
+    size_t chunk_size = options.relocation_chunk_size ? options.relocation_chunk_size : 1;
+
+    ElfLoadStats *stats = getWritableLoadStats();
+
+    for(const auto &iterator : getPackedRelocations()) {
+        ElfStatsTimer timer(stats, &ElfLoadStats::packed_relocation_nanoseconds);
+        processPackedRelocations(iterator.second);
+    }
+
+    // RELATIVE entries need no symbols so they all go through the tight loop first
+    map<Elf64_Half, size_t> relative_counts;
     for(const auto &iterator : getRelocations()) {
+        ElfStatsTimer timer(stats, &ElfLoadStats::relative_relocation_nanoseconds);
         const ElfRelocations &relocation_block = *iterator.second.get();
-        for(const Elf64_Rela relocation : relocation_block.relocations) {
-            Elf64_Xword relocation_type = ELF64_R_TYPE_ID(relocation.r_info);
-            Elf64_Xword symbol_index = ELF64_R_SYM(relocation.r_info);
-            const Elf64_Sym &symbol = relocation_block.symbols.symbols[symbol_index];
-            const char *symbol_name = &relocation_block.symbols.strings[symbol.st_name];
+        size_t relative_count = countRelativeRelocations(iterator.first, relocation_block);
+        relative_counts[iterator.first] = relative_count;
 
-            processRelocation(
-                relocation.r_offset, relocation_type, relocation.r_addend, symbol_name
-            );
+        const Elf64_Rela *begin = relocation_block.relocations.begin();
+        applyInChunks(pool.get(), chunk_size, begin, begin + relative_count, [this](
+            const Elf64_Rela *begin, const Elf64_Rela *end
+        ) {
+            processRelativeRelocations(begin, end);
+        });
+    }
+
+    checkCancelled(options.cancel_token);
+    const ElfRelocations *lazy_block = canBindLazily() ? setUpLazyBinding() : nullptr;
+
+    for(const auto &iterator : getRelocations()) {
+        const ElfRelocations &relocation_block = *iterator.second.get();
+        const Elf64_Rela *begin = relocation_block.relocations.begin() + relative_counts[iterator.first];
+        const Elf64_Rela *end = relocation_block.relocations.end();
+        bool lazy = &relocation_block == lazy_block;
+        vector<Elf64_Xword> symbol_values;
+        {
+            ElfStatsTimer timer(stats, &ElfLoadStats::symbol_resolution_nanoseconds);
+            symbol_values = resolveSymbols(relocation_block, begin, end, lazy);
+        }
+
+        ElfStatsTimer timer(stats, &ElfLoadStats::symbol_relocation_nanoseconds);
+        applyInChunks(pool.get(), chunk_size, begin, end, [this, &symbol_values, lazy](
+            const Elf64_Rela *begin, const Elf64_Rela *end
+        ) {
+            processRelocationRange(begin, end, symbol_values, lazy);
+        });
+    }
+
+    if(stats) {
+        countRelocations(*stats);
+    }
+
+    // Only publish the block once every slot points somewhere valid
+    plt_relocations = lazy_block;
+}
+
+void ElfModule::countRelocations(ElfLoadStats &stats) const {
+    // Counted apart from the passes so those stay untouched when stats are off
+    for(const auto &iterator : getPackedRelocations()) {
+        for(const Elf64_Relr entry : iterator.second) {
+            stats.relocation_counts[R_X86_64_RELATIVE] += entry & 1 ? __builtin_popcountll(entry >> 1) : 1;
+        }
+    }
+    for(const auto &iterator : getRelocations()) {
+        for(const Elf64_Rela &relocation : iterator.second->relocations) {
+            stats.relocation_counts[ELF64_R_TYPE_ID(relocation.r_info)]++;
+        }
+    }
+}
+
+bool ElfModule::canBindLazily() const {
+    if(!options.lazy_binding || !findDynamicEntry(DT_JMPREL) || !findDynamicEntry(DT_PLTGOT)) {
+        return false;
+    }
+
+    // Modules linked with -z now keep the GOT inside RELRO so it can't be patched later
+    const Elf64_Dyn *flags = findDynamicEntry(DT_FLAGS);
+    const Elf64_Dyn *flags_1 = findDynamicEntry(DT_FLAGS_1);
+    return !findDynamicEntry(DT_BIND_NOW)
+        && !(flags && (flags->d_un.d_val & DF_BIND_NOW))
+        && !(flags_1 && (flags_1->d_un.d_val & DF_1_BIND_NOW));
+}
+
+const ElfRelocations *ElfModule::setUpLazyBinding() {
+    Elf64_Addr jump_relocations = findDynamicEntry(DT_JMPREL)->d_un.d_ptr;
+    const ElfRelocations *lazy_block = nullptr;
+    for(const auto &iterator : getRelocations()) {
+        if(getSectionHeader(iterator.first).sh_addr == jump_relocations) {
+            lazy_block = iterator.second.get();
+        }
+    }
+    if(!lazy_block) {
+        return nullptr;
+    }
+
+    // GOT[1] is pushed by PLT0 to identify the module and GOT[2] is where PLT0 jumps
+    Elf64_Xword *got = (Elf64_Xword*)((char*)getImageBase() + findDynamicEntry(DT_PLTGOT)->d_un.d_ptr);
+    elfPrepareLazyBinding();
+    got[1] = (Elf64_Xword)this;
+    got[2] = (Elf64_Xword)elfLazyBindingTrampoline;
+    return lazy_block;
+}
+
+const void *ElfModule::bindLazySymbol(Elf64_Xword relocation_index) {
+    const Elf64_Rela &relocation = plt_relocations->relocations[relocation_index];
+    const Elf64_Sym &symbol = plt_relocations->symbols.symbols[ELF64_R_SYM(relocation.r_info)];
+    const void *address = getShim(&plt_relocations->symbols.strings[symbol.st_name]);
+
+    // Racing threads all write the same value so a plain aligned store is enough
+    *(const void**)((char*)getImageBase() + relocation.r_offset) = address;
+    return address;
+}
+
+size_t ElfModule::countRelativeRelocations(Elf64_Half section_index, const ElfRelocations &relocation_block) const {
+    // The linker sorts RELATIVE entries to the front of DT_RELA and records how many there are
+    const Elf64_Dyn *rela = findDynamicEntry(DT_RELA);
+    const Elf64_Dyn *rela_count = findDynamicEntry(DT_RELACOUNT);
+    if(rela && rela_count && rela->d_un.d_ptr == getSectionHeader(section_index).sh_addr) {
+        return min((size_t)rela_count->d_un.d_val, relocation_block.relocations.getLength());
+    }
+
+    // Otherwise take whatever run of them the block happens to start with
+    size_t count = 0;
+    for(const Elf64_Rela &relocation : relocation_block.relocations) {
+        if(ELF64_R_TYPE_ID(relocation.r_info) != R_X86_64_RELATIVE) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+void ElfModule::processRelativeRelocations(const Elf64_Rela *begin, const Elf64_Rela *end) {
+    char *image_base = (char*)getImageBase();
+    Elf64_Xword base_value = (Elf64_Xword)image_base;
+    const Elf64_Rela *relocation = begin;
+
+    // x86-64 has no scatter store short of AVX-512 so unroll instead and let the independent stores overlap
+    for(; end - relocation >= 4; relocation += 4) {
+        *(Elf64_Xword*)(image_base + relocation[0].r_offset) = base_value + relocation[0].r_addend;
+        *(Elf64_Xword*)(image_base + relocation[1].r_offset) = base_value + relocation[1].r_addend;
+        *(Elf64_Xword*)(image_base + relocation[2].r_offset) = base_value + relocation[2].r_addend;
+        *(Elf64_Xword*)(image_base + relocation[3].r_offset) = base_value + relocation[3].r_addend;
+    }
+    for(; relocation < end; relocation++) {
+        *(Elf64_Xword*)(image_base + relocation->r_offset) = base_value + relocation->r_addend;
+    }
+}
+
+void ElfModule::processPackedRelocations(const DynamicArray<const Elf64_Relr> &entries) {
+    char *image_base = (char*)getImageBase();
+    Elf64_Xword base_value = (Elf64_Xword)image_base;
+    Elf64_Xword *where = nullptr;
+
+    for(const Elf64_Relr entry : entries) {
+        if(!(entry & 1)) {
+            // An even entry is the offset of a relocation, the bitmaps that follow continue from the next word
+            where = (Elf64_Xword*)(image_base + entry);
+            *where++ += base_value;
+        } else {
+            // Each bitmap covers the next 63 words, bit 0 is only the marker
+            Elf64_Relr bits = entry >> 1;
+            while(bits) {
+                where[__builtin_ctzll(bits)] += base_value;
+                bits &= bits - 1;
+            }
+            where += sizeof(Elf64_Relr) * 8 - 1;
+        }
+    }
+}
+
+vector<Elf64_Xword> ElfModule::resolveSymbols(
+    const ElfRelocations &relocation_block, const Elf64_Rela *begin, const Elf64_Rela *end, bool lazy
+) {
+    vector<Elf64_Xword> symbol_values(relocation_block.symbols.symbols.getLength());
+    vector<bool> resolved(symbol_values.size());
+
+    for(const Elf64_Rela *relocation = begin; relocation < end; relocation++) {
+        Elf64_Xword symbol_index = ELF64_R_SYM(relocation->r_info);
+        switch(ELF64_R_TYPE_ID(relocation->r_info)) {
+        case R_X86_64_JMP_SLOT:
+            if(lazy) {
+                break;
+            }
+            // Fall through
+        case R_X86_64_64:
+        case R_X86_64_GLOB_DAT:
+            if(symbol_index && !resolved[symbol_index]) {
+                const Elf64_Sym &symbol = relocation_block.symbols.symbols[symbol_index];
+                const char *symbol_name = &relocation_block.symbols.strings[symbol.st_name];
+                symbol_values[symbol_index] = (Elf64_Xword)getShim(symbol_name);
+                resolved[symbol_index] = true;
+            }
+            break;
         }
     }
+    if(getWritableLoadStats()) {
+        getWritableLoadStats()->symbol_lookups += count(resolved.begin(), resolved.end(), true);
+    }
+    return symbol_values;
+}
+
+void ElfModule::processRelocationRange(
+    const Elf64_Rela *begin, const Elf64_Rela *end, const vector<Elf64_Xword> &symbol_values, bool lazy
+) {
+    for(const Elf64_Rela *relocation = begin; relocation < end; relocation++) {
+        if(lazy && ELF64_R_TYPE_ID(relocation->r_info) == R_X86_64_JMP_SLOT) {
+            // The slot holds the link time address of its PLT entry's push which leads to the trampoline
+            *(Elf64_Xword*)((char*)getImageBase() + relocation->r_offset) += (Elf64_Xword)getImageBase();
+            continue;
+        }
+        processRelocation(
+            relocation->r_offset,
+            ELF64_R_TYPE_ID(relocation->r_info),
+            relocation->r_addend,
+            symbol_values[ELF64_R_SYM(relocation->r_info)]
+        );
+    }
 }
 
-void ElfModule::processRelocation(Elf64_Addr offset, Elf64_Xword type, Elf64_Sxword addend, const char *symbol_name) {
+void ElfModule::processRelocation(Elf64_Addr offset, Elf64_Xword type, Elf64_Sxword addend, Elf64_Xword symbol_value) {
     Elf64_Xword dest_value;
 
     switch(type) {
@@ -33,7 +490,11 @@ void ElfModule::processRelocation(Elf64_Addr offset, Elf64_Xword type, Elf64_Sxw
 
         case R_X86_64_GLOB_DAT:
         case R_X86_64_JMP_SLOT:
-            dest_value = (Elf64_Xword)getShim(symbol_name);
+            dest_value = symbol_value;
+            break;
+
+        case R_X86_64_64:
+            dest_value = symbol_value + addend;
             break;
 
         default:
@@ -46,10 +507,5 @@ void ElfModule::processRelocation(Elf64_Addr offset, Elf64_Xword type, Elf64_Sxw
 }
 
 const void *ElfModule::getShim(const char *symbol_name) const {
-    auto iterator = shims.find(symbol_name);
-    if(iterator == shims.end()) {
-        throw UnresolvedSymbol(symbol_name);
-    } else {
-        return iterator->second;
-    }
+    return scope->resolve(symbol_name);
 }
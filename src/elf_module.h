@@ -1,22 +1,83 @@
 #ifndef __INC_ELF_MODULE_H_
 #define __INC_ELF_MODULE_H_
 
-#include <map>
 #include <string>
+#include <vector>
 #include "elf_image.h"
+#include "elf_load_options.h"
+#include "elf_lazy_binding.h"
+#include "elf_symbol_scope.h"
 
 class ElfModule : public ElfImage {
 public:
-    typedef std::map<const std::string, const void *> DynamicShims;
+    typedef ElfSymbolScope::Shims DynamicShims;
 
-    ElfModule(const DynamicShims &shims, std::istream &is);
+    ElfModule(const DynamicShims &shims, std::istream &is, const ElfLoadOptions &options = ElfLoadOptions());
+    ElfModule(const DynamicShims &shims, const std::string &path, const ElfLoadOptions &options = ElfLoadOptions());
+    ElfModule(const DynamicShims &shims, int fd, const ElfLoadOptions &options = ElfLoadOptions());
+    ElfModule(
+        const DynamicShims &shims,
+        std::shared_ptr<const char[]> buffer,
+        size_t size,
+        const ElfLoadOptions &options = ElfLoadOptions()
+    );
+    ElfModule(
+        const DynamicShims &shims, const void *buffer, size_t size, const ElfLoadOptions &options = ElfLoadOptions()
+    );
+
+    // Only needed with `defer_relocation`, the constructor relocates otherwise
+    // Repeat calls do nothing
+    void relocate();
+
+    // Runs DT_INIT and then the init arrays, call once the module and its dependencies are relocated
+    void initialize();
+    // Runs the fini arrays backwards and then DT_FINI, only if `initialize` ran and at most once for it
+    void finalize();
+
+    // Every module starts out in a scope of its own holding its shims and itself
+    // Modules loaded together share one so they see each other and resolve each name once
+    void setSymbolScope(std::shared_ptr<ElfSymbolScope> scope);
+    // Keeps a module this one was linked against alive for as long as this one is
+    void addDependency(std::shared_ptr<const ElfModule> dependency);
 
 private:
+    friend const void *elfBindLazySymbol(ElfModule *module, Elf64_Xword relocation_index);
+
+    // Image offsets whose relocated values depend on the image base and the ones holding symbol addresses
+    void collectFixups(std::vector<Elf64_Addr> &fixups, std::vector<ElfSymbolFixup> &symbol_fixups) const;
+
+    // Appends every function to the perf map in a single write, best effort like the cache
+    void writePerfMap() const;
+
+    void countRelocations(ElfLoadStats &stats) const;
+
+    bool canBindLazily() const;
+    // Points the PLT's GOT at the trampoline, returns the block the PLT slots are in
+    const ElfRelocations *setUpLazyBinding();
+    const void *bindLazySymbol(Elf64_Xword relocation_index);
+
     void processRelocations();
-    void processRelocation(Elf64_Addr offset, Elf64_Xword type, Elf64_Sxword addend, const char *symbol_name);
+    // Number of R_X86_64_RELATIVE entries the block starts with
+    size_t countRelativeRelocations(Elf64_Half section_index, const ElfRelocations &relocation_block) const;
+    void processRelativeRelocations(const Elf64_Rela *begin, const Elf64_Rela *end);
+    void processPackedRelocations(const DynamicArray<const Elf64_Relr> &entries);
+    // Looks up every symbol the entries reference once, indexed by symbol index
+    std::vector<Elf64_Xword> resolveSymbols(
+        const ElfRelocations &relocation_block, const Elf64_Rela *begin, const Elf64_Rela *end, bool lazy
+    );
+    void processRelocationRange(
+        const Elf64_Rela *begin, const Elf64_Rela *end, const std::vector<Elf64_Xword> &symbol_values, bool lazy
+    );
+    void processRelocation(Elf64_Addr offset, Elf64_Xword type, Elf64_Sxword addend, Elf64_Xword symbol_value);
     const void *getShim(const char *symbol_name) const;
 
-    DynamicShims shims;
+    std::shared_ptr<ElfSymbolScope> scope;
+    ElfLoadOptions options;
+    const ElfRelocations *plt_relocations = nullptr;
+    bool relocated = false;
+    bool initialized = false;
+
+    std::vector<std::shared_ptr<const ElfModule>> dependencies;
 };
 
 #endif//__INC_ELF_MODULE_H_
@@ -0,0 +1,252 @@
+#include <fcntl.h>
+#include <future>
+#include <map>
+#include <unistd.h>
+#include "exceptions.h"
+#include "elf_module_loader.h"
+#include "elf_module_registry.h"
+#include "thread_pool.h"
+using namespace std;
+
+struct LoaderNode {
+    string path;
+    shared_ptr<ElfModule> module;
+    vector<size_t> needed;
+    // Already open in the registry so it's relocated and initialized
+    bool shared;
+    ElfModuleRegistry::FileKey key;
+};
+
+ElfModuleLoader::ElfModuleLoader(const ElfModule::DynamicShims &shims, const ElfLoadOptions &options, unsigned threads)
+    : shims(shims), options(options), threads(threads ? threads : 1) {
+    // Every module is relocated by `load` once the whole graph is known
+    this->options.defer_relocation = true;
+    // Frozen so every module's scope shares the one copy
+    this->shims.freeze();
+}
+
+ElfModuleLoader::~ElfModuleLoader() {
+    // Loads in flight still use everything else here
+    executor.reset();
+}
+
+void ElfModuleLoader::addSearchPath(const string &directory) {
+    search_paths.push_back(directory);
+}
+
+void ElfModuleLoader::provideLibrary(const string &name) {
+    provided_libraries.insert(name);
+}
+
+void ElfModuleLoader::provideMissingLibraries() {
+    provide_missing_libraries = true;
+}
+
+string ElfModuleLoader::findLibrary(const string &name) const {
+    if(name.find('/') != string::npos) {
+        return access(name.c_str(), R_OK) ? string() : name;
+    }
+    for(const string &directory : search_paths) {
+        string path = directory + "/" + name;
+        if(!access(path.c_str(), R_OK)) {
+            return path;
+        }
+    }
+    return string();
+}
+
+static void destroyModule(ElfModule *module) {
+    module->finalize();
+    delete module;
+}
+
+// Dependencies before dependents, cycles are broken wherever the walk first closes them
+static void sortTopologically(const vector<LoaderNode> &nodes, size_t index, vector<bool> &visited, vector<size_t> &order) {
+    visited[index] = true;
+    for(size_t needed : nodes[index].needed) {
+        if(!visited[needed]) {
+            sortTopologically(nodes, needed, visited, order);
+        }
+    }
+    order.push_back(index);
+}
+
+shared_ptr<ElfModule> ElfModuleLoader::load(const string &path) {
+    return loadGraph(path, options);
+}
+
+shared_ptr<ElfModule> ElfModuleLoader::load(const string &path, ElfModuleRegistry &registry) {
+    return loadGraph(path, options, &registry);
+}
+
+future<shared_ptr<ElfModule>> ElfModuleLoader::loadAsync(
+    const string &path, LoadCallback callback, shared_ptr<ElfCancelToken> cancel_token
+) {
+    call_once(executor_started, [this]() {
+        executor.reset(new ThreadPool(threads));
+    });
+
+    return executor->submit([this, path, callback, cancel_token]() {
+        ElfLoadOptions load_options = options;
+        if(cancel_token) {
+            load_options.cancel_token = cancel_token;
+        }
+
+        shared_ptr<ElfModule> module;
+        try {
+            module = loadGraph(path, load_options);
+        } catch(...) {
+            if(callback) {
+                callback(nullptr, current_exception());
+            }
+            throw;
+        }
+        if(callback) {
+            callback(module, nullptr);
+        }
+        return module;
+    });
+}
+
+shared_ptr<ElfModule> ElfModuleLoader::openShared(
+    const string &path,
+    const ElfLoadOptions &options,
+    ElfModuleRegistry &registry,
+    ElfModuleRegistry::FileKey &key,
+    bool &shared
+) const {
+    // Key and load from the same descriptor so a file replaced in between can't be mixed up
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw FileAccessError();
+    }
+    shared_ptr<ElfModule> module;
+    try {
+        key = ElfModuleRegistry::getFileKey(fd);
+        module = registry.find(key);
+        shared = (bool)module;
+        if(!shared) {
+            // Owned here until the registry has it so nothing leaks if anything throws first
+            unique_ptr<ElfModule> loaded(new ElfModule(shims, fd, options));
+            module = registry.adopt(key, move(loaded));
+        }
+    } catch(...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return module;
+}
+
+shared_ptr<ElfModule> ElfModuleLoader::loadGraph(
+    const string &path, const ElfLoadOptions &options, ElfModuleRegistry *registry
+) {
+    // Modules are only added at the end so another load of the same files has to wait for this one
+    unique_lock<mutex> registry_lock;
+    if(registry) {
+        registry_lock = unique_lock<mutex>(registry->load_mutex);
+    }
+
+    ThreadPool pool(threads);
+    vector<LoaderNode> nodes;
+    map<string, size_t> node_indexes;
+
+    nodes.push_back({path, nullptr, {}, false, {}});
+    node_indexes[path] = 0;
+
+    // Each round parses every library the previous round discovered at once
+    size_t round_start = 0;
+    while(round_start < nodes.size()) {
+        checkCancelled(options.cancel_token);
+        size_t round_end = nodes.size();
+        // Nothing is added to `nodes` until the whole round is done
+        vector<future<void>> parsed;
+        for(size_t i = round_start; i < round_end; i++) {
+            LoaderNode &node = nodes[i];
+            parsed.push_back(pool.submit([this, &node, &options, registry]() {
+                if(registry) {
+                    node.module = openShared(node.path, options, *registry, node.key, node.shared);
+                } else {
+                    unique_ptr<ElfModule> module(new ElfModule(shims, node.path, options));
+                    node.module = shared_ptr<ElfModule>(module.release(), destroyModule);
+                }
+            }));
+        }
+
+        for(future<void> &result : parsed) {
+            result.wait();
+        }
+        for(future<void> &result : parsed) {
+            result.get();
+        }
+        // An open root already holds its whole graph
+        if(nodes[0].shared) {
+            return nodes[0].module;
+        }
+
+        for(size_t i = round_start; i < round_end; i++) {
+            for(const string &name : nodes[i].module->getNeededLibraries()) {
+                if(provided_libraries.count(name)) {
+                    continue;
+                }
+                string library_path = findLibrary(name);
+                if(library_path.empty()) {
+                    if(provide_missing_libraries) {
+                        continue;
+                    }
+                    throw UnresolvedLibrary(name);
+                }
+                auto iterator = node_indexes.find(library_path);
+                if(iterator == node_indexes.end()) {
+                    iterator = node_indexes.emplace(library_path, nodes.size()).first;
+                    nodes.push_back({library_path, nullptr, {}, false, {}});
+                }
+                nodes[i].needed.push_back(iterator->second);
+            }
+        }
+        round_start = round_end;
+    }
+
+    // Like the global scope, symbols are searched in breadth first load order which is the node order
+    auto scope = make_shared<ElfSymbolScope>(shims);
+    for(const LoaderNode &node : nodes) {
+        scope->addImage(node.module.get());
+    }
+
+    vector<bool> visited(nodes.size());
+    vector<size_t> order;
+    sortTopologically(nodes, 0, visited, order);
+
+    vector<bool> relocated(nodes.size());
+    for(size_t index : order) {
+        LoaderNode &node = nodes[index];
+        if(node.shared) {
+            relocated[index] = true;
+            continue;
+        }
+        for(size_t needed : node.needed) {
+            // Only hold on to what's already relocated so cycles don't keep each other alive
+            if(relocated[needed]) {
+                node.module->addDependency(nodes[needed].module);
+            }
+        }
+        node.module->setSymbolScope(scope);
+        node.module->relocate();
+        relocated[index] = true;
+    }
+
+    // Initializers run module code, a load cancelled by now stops before any of it does
+    checkCancelled(options.cancel_token);
+
+    // Dependencies first, a later failure still finalizes whatever was initialized when the nodes go
+    for(size_t index : order) {
+        LoaderNode &node = nodes[index];
+        if(!node.shared) {
+            node.module->initialize();
+            if(registry) {
+                registry->add(node.key, node.module);
+            }
+        }
+    }
+    return nodes[0].module;
+}
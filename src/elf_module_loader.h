@@ -0,0 +1,82 @@
+#ifndef __INC_ELF_MODULE_LOADER_H_
+#define __INC_ELF_MODULE_LOADER_H_
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "elf_cancel_token.h"
+#include "elf_module.h"
+#include "elf_module_registry.h"
+#include "elf_load_options.h"
+
+class ThreadPool;
+
+// Loads a module together with everything it names in DT_NEEDED
+// Libraries are parsed and mapped concurrently, then relocated and initialized dependencies first
+// Each module is finalized when its last handle goes, dependents hold their dependencies so that's in reverse
+class ElfModuleLoader {
+public:
+    // Gets the root module when the load worked and the exception it threw otherwise
+    typedef std::function<void(std::shared_ptr<ElfModule> module, std::exception_ptr error)> LoadCallback;
+
+    ElfModuleLoader(
+        const ElfModule::DynamicShims &shims,
+        const ElfLoadOptions &options = ElfLoadOptions(),
+        unsigned threads = std::thread::hardware_concurrency()
+    );
+    // Waits for any loads still running in the background
+    ~ElfModuleLoader();
+
+    // Directories searched in order for DT_NEEDED names without a slash
+    void addSearchPath(const std::string &directory);
+    // Skips a DT_NEEDED name because the host supplies it, its symbols have to come from the shims
+    void provideLibrary(const std::string &name);
+    // Treats every DT_NEEDED name no search path has like `provideLibrary`, the way a lone ElfModule ignores DT_NEEDED
+    void provideMissingLibraries();
+
+    // Returns the root module, it keeps all of its dependencies alive
+    std::shared_ptr<ElfModule> load(const std::string &path);
+    // Same but every library already open in `registry` is shared and the rest are initialized and added to it
+    std::shared_ptr<ElfModule> load(const std::string &path, ElfModuleRegistry &registry);
+    // Does the same as `load` on threads the loader owns so the caller never waits on the disk or the relocations
+    // `callback` runs on the loading thread before the future is ready
+    // Cancelling `cancel_token` makes the load throw LoadCancelled from the next phase it starts
+    std::future<std::shared_ptr<ElfModule>> loadAsync(
+        const std::string &path,
+        LoadCallback callback = nullptr,
+        std::shared_ptr<ElfCancelToken> cancel_token = nullptr
+    );
+
+private:
+    std::shared_ptr<ElfModule> loadGraph(
+        const std::string &path, const ElfLoadOptions &options, ElfModuleRegistry *registry = nullptr
+    );
+    // Empty when the library isn't there
+    std::string findLibrary(const std::string &name) const;
+    // Shares the module when `registry` has the file open already, otherwise parses it for the registry to take over
+    std::shared_ptr<ElfModule> openShared(
+        const std::string &path,
+        const ElfLoadOptions &options,
+        ElfModuleRegistry &registry,
+        ElfModuleRegistry::FileKey &key,
+        bool &shared
+    ) const;
+
+    ElfModule::DynamicShims shims;
+    ElfLoadOptions options;
+    unsigned threads;
+    std::vector<std::string> search_paths;
+    std::set<std::string> provided_libraries;
+    bool provide_missing_libraries = false;
+    // Runs `loadAsync`, started by the first call
+    std::once_flag executor_started;
+    std::unique_ptr<ThreadPool> executor;
+};
+
+#endif//__INC_ELF_MODULE_LOADER_H_
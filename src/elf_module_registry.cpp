@@ -0,0 +1,67 @@
+#include <sys/stat.h>
+#include "exceptions.h"
+#include "elf_module_loader.h"
+#include "elf_module_registry.h"
+using namespace std;
+
+ElfModuleRegistry &ElfModuleRegistry::getInstance() {
+    static ElfModuleRegistry registry;
+    return registry;
+}
+
+shared_ptr<ElfModule> ElfModuleRegistry::open(
+    const string &path, const ElfModule::DynamicShims &shims, const ElfLoadOptions &options
+) {
+    ElfModuleLoader loader(shims, options);
+    loader.provideMissingLibraries();
+    return loader.load(path, *this);
+}
+
+shared_ptr<ElfModule> ElfModuleRegistry::open(const string &path, ElfModuleLoader &loader) {
+    return loader.load(path, *this);
+}
+
+size_t ElfModuleRegistry::getModuleCount() {
+    lock_guard<mutex> lock(entries_mutex);
+    return entries.size();
+}
+
+ElfModuleRegistry::FileKey ElfModuleRegistry::getFileKey(int fd) {
+    struct stat file_stat;
+    if(fstat(fd, &file_stat)) {
+        throw FileAccessError();
+    }
+    return FileKey(file_stat.st_dev, file_stat.st_ino, file_stat.st_mtim.tv_sec, file_stat.st_mtim.tv_nsec);
+}
+
+shared_ptr<ElfModule> ElfModuleRegistry::find(const FileKey &key) {
+    lock_guard<mutex> lock(entries_mutex);
+    auto iterator = entries.find(key);
+    if(iterator == entries.end()) {
+        return nullptr;
+    }
+    return iterator->second.handle.lock();
+}
+
+shared_ptr<ElfModule> ElfModuleRegistry::adopt(const FileKey &key, unique_ptr<ElfModule> module) {
+    // Finalizing is up to the module alone, a load which failed before initializing it makes this a no-op
+    return shared_ptr<ElfModule>(module.release(), [this, key](ElfModule *module) {
+        module->finalize();
+        release(key, module);
+        delete module;
+    });
+}
+
+void ElfModuleRegistry::add(const FileKey &key, const shared_ptr<ElfModule> &module) {
+    lock_guard<mutex> lock(entries_mutex);
+    entries[key] = Entry{module.get(), module};
+}
+
+void ElfModuleRegistry::release(const FileKey &key, const ElfModule *module) {
+    lock_guard<mutex> lock(entries_mutex);
+    auto iterator = entries.find(key);
+    // Modules from a failed load were never added
+    if(iterator != entries.end() && iterator->second.module == module) {
+        entries.erase(iterator);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef __INC_ELF_MODULE_REGISTRY_H_
+#define __INC_ELF_MODULE_REGISTRY_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <sys/types.h>
+#include "elf_module.h"
+#include "elf_load_options.h"
+
+class ElfModuleLoader;
+
+// Process wide table of loaded modules so the same file is only ever loaded once
+// Modules are initialized on first open and finalized and unmapped when the last handle goes away
+class ElfModuleRegistry {
+public:
+    // Files are matched by device, inode and modification time
+    typedef std::tuple<dev_t, ino_t, time_t, long> FileKey;
+
+    static ElfModuleRegistry &getInstance();
+
+    // Loads `path` and whichever of its DT_NEEDED libraries are paths that exist, any of them already open are shared
+    // Other names are left to `shims` like a lone ElfModule does, `shims` and `options` only apply to modules this loads
+    std::shared_ptr<ElfModule> open(
+        const std::string &path, const ElfModule::DynamicShims &shims, const ElfLoadOptions &options = ElfLoadOptions()
+    );
+    // Same as `loader.load(path, *this)`, dependencies are searched for however `loader` is set up
+    std::shared_ptr<ElfModule> open(const std::string &path, ElfModuleLoader &loader);
+
+    // Number of modules currently loaded through the registry
+    size_t getModuleCount();
+
+    // Throws FileAccessError
+    static FileKey getFileKey(int fd);
+
+private:
+    friend class ElfModuleLoader;
+
+    struct Entry {
+        // Tells a release whether the entry is still its module's, the handle has expired by then
+        const ElfModule *module;
+        std::weak_ptr<ElfModule> handle;
+    };
+
+    ElfModuleRegistry() { }
+
+    // The module open for `key` or null
+    std::shared_ptr<ElfModule> find(const FileKey &key);
+    // Takes over a module the loader just created, dropping the last handle finalizes it and drops its entry
+    std::shared_ptr<ElfModule> adopt(const FileKey &key, std::unique_ptr<ElfModule> module);
+    // Makes an adopted module visible to later loads, it has to be relocated and initialized
+    void add(const FileKey &key, const std::shared_ptr<ElfModule> &module);
+    // A later load may have replaced the entry already, that one is left alone
+    void release(const FileKey &key, const ElfModule *module);
+
+    // Held by a loader for its whole load so two loads never bring in the same file twice
+    std::mutex load_mutex;
+
+    std::mutex entries_mutex;
+    std::map<FileKey, Entry> entries;
+};
+
+#endif//__INC_ELF_MODULE_REGISTRY_H_
@@ -0,0 +1,119 @@
+#include "exceptions.h"
+#include "elf_shim_table.h"
+using namespace std;
+
+ElfShimTable::ElfShimTable() : storage(make_shared<Storage>()), frozen(false) { }
+
+ElfShimTable::ElfShimTable(const ElfShimTable &other) : storage(other.storage), frozen(other.frozen) {
+    // Only frozen storage can be shared, anything else could still change under the copy
+    if(!frozen) {
+        storage = make_shared<Storage>(*other.storage);
+    }
+}
+
+ElfShimTable &ElfShimTable::operator=(const ElfShimTable &other) {
+    if(this != &other) {
+        ElfShimTable copy(other);
+        *this = move(copy);
+    }
+    return *this;
+}
+
+const void *&ElfShimTable::operator[](string_view name) {
+    if(frozen) {
+        throw FrozenShimTable();
+    }
+    return findOrAdd(name, elfGnuHash(name));
+}
+
+void ElfShimTable::insert(string_view name, const void *address) {
+    (*this)[name] = address;
+}
+
+bool ElfShimTable::find(string_view name, const void *&address) const {
+    return find(name, elfGnuHash(name), address);
+}
+
+bool ElfShimTable::find(string_view name, uint32_t hash, const void *&address) const {
+    if(storage->static_index) {
+        size_t index = storage->static_index(storage->static_names, name, hash);
+        if(index == storage->entries.size()) {
+            return false;
+        }
+        address = storage->entries[index].second;
+        return true;
+    }
+
+    const vector<Slot> &slots = storage->slots;
+    if(slots.empty()) {
+        return false;
+    }
+
+    size_t mask = slots.size() - 1;
+    for(size_t slot = elfMixShimHash(hash, 0) & mask; slots[slot].entry; slot = (slot + 1) & mask) {
+        if(slots[slot].hash == hash) {
+            const value_type &entry = storage->entries[slots[slot].entry - 1];
+            if(entry.first == name) {
+                address = entry.second;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ElfShimTable::freeze() {
+    storage->entries.shrink_to_fit();
+    frozen = true;
+}
+
+const void *&ElfShimTable::findOrAdd(string_view name, uint32_t hash) {
+    vector<value_type> &entries = storage->entries;
+    while(true) {
+        vector<Slot> &slots = storage->slots;
+        size_t mask = slots.size() - 1;
+        size_t slot = elfMixShimHash(hash, 0) & mask;
+        for(; !slots.empty() && slots[slot].entry; slot = (slot + 1) & mask) {
+            if(slots[slot].hash == hash) {
+                value_type &entry = entries[slots[slot].entry - 1];
+                if(entry.first == name) {
+                    return entry.second;
+                }
+            }
+        }
+
+        // Keep the load factor at or below one half so probe sequences stay short
+        if((entries.size() + 1) * 2 > slots.size()) {
+            rehash((entries.size() + 1) * 2);
+            continue;
+        }
+
+        entries.emplace_back(string(name), nullptr);
+        slots[slot] = Slot{hash, (uint32_t)entries.size()};
+        return entries.back().second;
+    }
+}
+
+void ElfShimTable::rehash(size_t capacity) {
+    size_t rounded = 1;
+    while(rounded < capacity) {
+        rounded <<= 1;
+    }
+    if(rounded <= storage->slots.size()) {
+        return;
+    }
+
+    vector<Slot> slots(rounded, Slot{0, 0});
+    size_t mask = rounded - 1;
+    for(const Slot &old_slot : storage->slots) {
+        if(!old_slot.entry) {
+            continue;
+        }
+        size_t slot = elfMixShimHash(old_slot.hash, 0) & mask;
+        while(slots[slot].entry) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = old_slot;
+    }
+    storage->slots = move(slots);
+}
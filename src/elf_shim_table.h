@@ -0,0 +1,199 @@
+#ifndef __INC_ELF_SHIM_TABLE_H_
+#define __INC_ELF_SHIM_TABLE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "elf_hash.h"
+
+template <size_t N>
+class ElfStaticShims;
+
+// Host functions handed to loaded modules by name
+// Entries live in a flat open addressing table next to their GNU hash so lookups by `string_view` never allocate
+// Tables built from an ElfStaticShims set probe its perfect hash instead
+// Once frozen the table can't change and copies share its storage
+class ElfShimTable {
+public:
+    typedef std::pair<std::string, const void *> value_type;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    ElfShimTable();
+    ElfShimTable(const ElfShimTable &other);
+    ElfShimTable(ElfShimTable &&other) = default;
+    // A frozen table holding `names` in declaration order, lookups go through the set's perfect hash
+    // `names` is only referenced so it has to outlive the table and its copies, it's meant to be static
+    template <size_t N>
+    ElfShimTable(const ElfStaticShims<N> &names, const void *const (&addresses)[N]);
+
+    ElfShimTable &operator=(const ElfShimTable &other);
+    ElfShimTable &operator=(ElfShimTable &&other) = default;
+
+    // Adds `name` as null if it isn't in the table yet, throws FrozenShimTable once frozen
+    // The reference points into the table's storage, adding any other name may invalidate it
+    const void *&operator[](std::string_view name);
+    // Adds `name` or replaces its address, throws FrozenShimTable once frozen
+    void insert(std::string_view name, const void *address);
+
+    // Returns false when `name` isn't in the table, shims themselves may be null
+    bool find(std::string_view name, const void *&address) const;
+    // `hash` is `elfGnuHash(name)`
+    bool find(std::string_view name, uint32_t hash, const void *&address) const;
+
+    void freeze();
+    bool isFrozen() const { return frozen; }
+
+    size_t size() const { return storage->entries.size(); }
+    // Entries in insertion order
+    const_iterator begin() const { return storage->entries.begin(); }
+    const_iterator end() const { return storage->entries.end(); }
+
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t entry;  // One past the entry's index so zero marks an empty slot
+    };
+
+    struct Storage {
+        std::vector<value_type> entries;
+        std::vector<Slot> slots;
+        // Set instead of `slots` for tables built from ElfStaticShims, `static_index` is its `indexOf`
+        const void *static_names = nullptr;
+        size_t (*static_index)(const void *names, std::string_view name, uint32_t hash) = nullptr;
+    };
+
+    const void *&findOrAdd(std::string_view name, uint32_t hash);
+    void rehash(size_t capacity);
+
+    std::shared_ptr<Storage> storage;
+    bool frozen;
+};
+
+constexpr uint32_t elfMixShimHash(uint32_t hash, uint32_t seed) {
+    uint32_t mixed = (hash ^ seed) * 0x9e3779b1u;
+    return mixed ^ (mixed >> 16);
+}
+
+// A shim name set with a perfect hash worked out at compile time
+// Every bucket of names gets the first seed which sends all of them to free slots, so a lookup is one probe
+// Duplicate names fail to compile
+//     static constexpr std::string_view names[] = {"printf", "puts"};
+//     static constexpr ElfStaticShims<2> host_shims(names);
+//     ElfShimTable shims(host_shims, {(const void*)printShim, (const void*)putsShim});
+template <size_t N>
+class ElfStaticShims {
+public:
+    static_assert(N > 0, "A static shim set needs at least one name");
+
+    constexpr ElfStaticShims(const std::string_view (&names)[N]) : names(), hashes(), seeds(), slots() {
+        // Group names by bucket, buckets are placed largest first while there's the most room
+        size_t bucket_sizes[N] = {};
+        for(size_t i = 0; i < N; i++) {
+            this->names[i] = names[i];
+            hashes[i] = elfGnuHash(names[i]);
+            bucket_sizes[hashes[i] % N]++;
+        }
+
+        size_t bucket_starts[N + 1] = {};
+        for(size_t bucket = 0; bucket < N; bucket++) {
+            bucket_starts[bucket + 1] = bucket_starts[bucket] + bucket_sizes[bucket];
+        }
+        size_t members[N] = {};
+        size_t filled[N] = {};
+        for(size_t i = 0; i < N; i++) {
+            size_t bucket = hashes[i] % N;
+            members[bucket_starts[bucket] + filled[bucket]++] = i;
+        }
+
+        // Counting sort, bucket sizes never exceed N
+        size_t size_counts[N + 1] = {};
+        for(size_t bucket = 0; bucket < N; bucket++) {
+            size_counts[bucket_sizes[bucket]]++;
+        }
+        size_t size_starts[N + 1] = {};
+        for(size_t size = N; size > 0; size--) {
+            size_starts[size - 1] = size_starts[size] + size_counts[size];
+        }
+        size_t order[N] = {};
+        for(size_t bucket = 0; bucket < N; bucket++) {
+            order[size_starts[bucket_sizes[bucket]]++] = bucket;
+        }
+
+        // Half the slots stay empty which keeps the seed search short
+        for(size_t slot = 0; slot < slot_count; slot++) {
+            slots[slot] = N;
+        }
+        size_t taken[N] = {};
+        for(size_t bucket : order) {
+            if(!bucket_sizes[bucket]) {
+                break;
+            }
+            for(uint32_t seed = 1;; seed++) {
+                if(seed > max_seed) {
+                    throw "No perfect hash, are there duplicate names?";
+                }
+                size_t count = 0;
+                for(size_t k = bucket_starts[bucket]; k < bucket_starts[bucket + 1]; k++) {
+                    size_t slot = elfMixShimHash(hashes[members[k]], seed) % slot_count;
+                    bool clash = slots[slot] != N;
+                    for(size_t t = 0; t < count; t++) {
+                        clash |= taken[t] == slot;
+                    }
+                    if(clash) {
+                        break;
+                    }
+                    taken[count++] = slot;
+                }
+                if(count == bucket_sizes[bucket]) {
+                    for(size_t t = 0; t < count; t++) {
+                        slots[taken[t]] = members[bucket_starts[bucket] + t];
+                    }
+                    seeds[bucket] = seed;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Position of `name` in the declaration or N when it isn't in the set
+    constexpr size_t indexOf(std::string_view name) const {
+        return indexOf(name, elfGnuHash(name));
+    }
+
+    constexpr size_t indexOf(std::string_view name, uint32_t hash) const {
+        size_t index = slots[elfMixShimHash(hash, seeds[hash % N]) % slot_count];
+        return index != N && hashes[index] == hash && names[index] == name ? index : N;
+    }
+
+    constexpr size_t size() const { return N; }
+    constexpr std::string_view getName(size_t index) const { return names[index]; }
+    constexpr uint32_t getHash(size_t index) const { return hashes[index]; }
+
+private:
+    static constexpr uint32_t max_seed = 1 << 16;
+    static constexpr size_t slot_count = N * 2;
+
+    std::string_view names[N];
+    uint32_t hashes[N];
+    uint32_t seeds[N];
+    size_t slots[slot_count];  // N marks an empty slot
+};
+
+template <size_t N>
+ElfShimTable::ElfShimTable(const ElfStaticShims<N> &names, const void *const (&addresses)[N]) : ElfShimTable() {
+    // Entries line up with the declaration so the set's index is also the entry's
+    storage->entries.reserve(N);
+    for(size_t i = 0; i < N; i++) {
+        storage->entries.emplace_back(std::string(names.getName(i)), addresses[i]);
+    }
+    storage->static_names = &names;
+    storage->static_index = [](const void *names, std::string_view name, uint32_t hash) {
+        return static_cast<const ElfStaticShims<N>*>(names)->indexOf(name, hash);
+    };
+    freeze();
+}
+
+#endif//__INC_ELF_SHIM_TABLE_H_
@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "exceptions.h"
+#include "elf_source.h"
+#include "elf_io_queue.h"
+using namespace std;
+
+shared_ptr<const char[]> ElfSource::view(Elf64_Off, size_t) {
+    return nullptr;
+}
+
+bool ElfSource::map(void *, Elf64_Off, size_t) {
+    return false;
+}
+
+void ElfSource::readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        read(offset, buffers[i].iov_len, buffers[i].iov_base);
+        offset += buffers[i].iov_len;
+    }
+}
+
+void ElfSource::readScatteredBatch(const vector<ElfScatteredRead> &reads) {
+    for(const ElfScatteredRead &read : reads) {
+        readScattered(read.offset, read.buffers.data(), read.buffers.size());
+    }
+}
+
+// Requests further apart than this are read separately rather than reading the bytes between them
+static constexpr size_t coalesce_gap = 4096;
+
+// `requests` are sorted by offset and don't overlap
+// The buffers stay alive through `requests` and `gap` until the read is done
+static ElfScatteredRead planRun(ElfReadRequest **requests, size_t count, unique_ptr<char[]> &gap) {
+    // Requests without a destination share one buffer and whatever lies between requests is read into scratch
+    size_t shared_size = 0;
+    size_t gap_size = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(!requests[i]->dest) {
+            shared_size += requests[i]->size;
+        }
+        if(i) {
+            gap_size = max(gap_size, (size_t)(requests[i]->offset - requests[i - 1]->offset - requests[i - 1]->size));
+        }
+    }
+    shared_ptr<char[]> shared(new char[shared_size]);
+    gap.reset(new char[gap_size]);
+
+    ElfScatteredRead read = {requests[0]->offset, {}};
+    size_t shared_offset = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(i) {
+            size_t skipped = requests[i]->offset - requests[i - 1]->offset - requests[i - 1]->size;
+            if(skipped) {
+                read.buffers.push_back({gap.get(), skipped});
+            }
+        }
+        if(requests[i]->dest) {
+            read.buffers.push_back({requests[i]->dest, requests[i]->size});
+        } else {
+            read.buffers.push_back({&shared[shared_offset], requests[i]->size});
+            requests[i]->data = shared_ptr<const char[]>(shared, &shared[shared_offset]);
+            shared_offset += requests[i]->size;
+        }
+    }
+    return read;
+}
+
+void ElfSource::readBatch(vector<ElfReadRequest> &requests) {
+    vector<ElfReadRequest*> pending;
+    for(ElfReadRequest &request : requests) {
+        if(!request.dest) {
+            request.data = view(request.offset, request.size);
+            if(request.data) {
+                continue;
+            }
+        }
+        pending.push_back(&request);
+    }
+
+    sort(pending.begin(), pending.end(), [](const ElfReadRequest *a, const ElfReadRequest *b) {
+        return a->offset < b->offset;
+    });
+
+    // Overlapping requests just start a new run
+    vector<ElfScatteredRead> reads;
+    vector<unique_ptr<char[]>> gaps;
+    size_t run_start = 0;
+    while(run_start < pending.size()) {
+        size_t run_end = run_start + 1;
+        Elf64_Off end_offset = pending[run_start]->offset + pending[run_start]->size;
+        while(run_end < pending.size()
+            && pending[run_end]->offset >= end_offset
+            && pending[run_end]->offset - end_offset <= coalesce_gap
+        ) {
+            end_offset = pending[run_end]->offset + pending[run_end]->size;
+            run_end++;
+        }
+        gaps.emplace_back();
+        reads.push_back(planRun(&pending[run_start], run_end - run_start, gaps.back()));
+        run_start = run_end;
+    }
+
+    // Every run goes out at once so sources which can overlap them do
+    if(!reads.empty()) {
+        readScatteredBatch(reads);
+    }
+}
+
+ElfStreamSource::ElfStreamSource(istream &is) : is(is) { }
+
+void ElfStreamSource::read(Elf64_Off offset, size_t size, void *dest) {
+    is.seekg(offset);
+    is.read((char*)dest, size);
+}
+
+void ElfStreamSource::readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count) {
+    // The buffers are consecutive in the file so only the first needs a seek
+    is.seekg(offset);
+    for(size_t i = 0; i < count; i++) {
+        is.read((char*)buffers[i].iov_base, buffers[i].iov_len);
+    }
+}
+
+ElfBufferSource::ElfBufferSource() : buffer_size(0) { }
+
+ElfBufferSource::ElfBufferSource(shared_ptr<const char[]> buffer, size_t size) : buffer(buffer), buffer_size(size) { }
+
+void ElfBufferSource::checkRange(Elf64_Off offset, size_t size) const {
+    if(offset > buffer_size || size > buffer_size - offset) {
+        throw TruncatedFile();
+    }
+}
+
+void ElfBufferSource::read(Elf64_Off offset, size_t size, void *dest) {
+    checkRange(offset, size);
+    memcpy(dest, &buffer[offset], size);
+}
+
+shared_ptr<const char[]> ElfBufferSource::view(Elf64_Off offset, size_t size) {
+    checkRange(offset, size);
+    return shared_ptr<const char[]>(buffer, &buffer[offset]);
+}
+
+ElfMappedSource::ElfMappedSource(const string &path) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw FileAccessError();
+    }
+    mapFile();
+}
+
+ElfMappedSource::ElfMappedSource(int fd) {
+    // The caller keeps ownership of their descriptor
+    this->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if(this->fd < 0) {
+        throw FileAccessError();
+    }
+    mapFile();
+}
+
+ElfMappedSource::~ElfMappedSource() {
+    // Mappings outlive the descriptor so this is always safe
+    close(fd);
+}
+
+void ElfMappedSource::mapFile() {
+    struct stat file_stat;
+    if(fstat(fd, &file_stat)) {
+        close(fd);
+        throw FileAccessError();
+    }
+
+    buffer_size = file_stat.st_size;
+    if(!buffer_size) {
+        close(fd);
+        throw TruncatedFile();
+    }
+
+    void *ptr = mmap(nullptr, buffer_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(ptr == MAP_FAILED) {
+        close(fd);
+        throw FileAccessError();
+    }
+
+    size_t length = buffer_size;
+    buffer = shared_ptr<const char[]>((const char*)ptr, [length](const char *ptr) {
+        munmap((void*)ptr, length);
+    });
+}
+
+bool ElfMappedSource::map(void *address, Elf64_Off offset, size_t size) {
+    size_t page_size = getPageSize();
+    size_t page_offset = (size_t)address % page_size;
+
+    // The kernel can only map whole pages so the file has to line up with memory
+    if(page_offset != offset % page_size) {
+        return false;
+    }
+
+    checkRange(offset, size);
+    if(!size) {
+        return true;
+    }
+
+    void *page_address = (char*)address - page_offset;
+    void *ptr = mmap(
+        page_address, size + page_offset, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset - page_offset
+    );
+    if(ptr == MAP_FAILED) {
+        throw FileAccessError();
+    }
+    return true;
+}
+
+ElfFileSource::ElfFileSource(const string &path) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw FileAccessError();
+    }
+}
+
+ElfFileSource::ElfFileSource(int fd) {
+    // The caller keeps ownership of their descriptor
+    this->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if(this->fd < 0) {
+        throw FileAccessError();
+    }
+}
+
+ElfFileSource::~ElfFileSource() {
+    close(fd);
+}
+
+void ElfFileSource::read(Elf64_Off offset, size_t size, void *dest) {
+    struct iovec buffer = {dest, size};
+    readScattered(offset, &buffer, 1);
+}
+
+void ElfFileSource::readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count) {
+    readFileScattered(fd, offset, buffers, count);
+}
+
+void readFileScattered(int fd, Elf64_Off offset, const struct iovec *buffers, size_t count) {
+    vector<struct iovec> remaining(buffers, buffers + count);
+    size_t next = 0;
+    while(next < remaining.size()) {
+        if(!remaining[next].iov_len) {
+            next++;
+            continue;
+        }
+
+        ssize_t result = preadv(fd, &remaining[next], min(remaining.size() - next, (size_t)IOV_MAX), offset);
+        if(result < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw FileAccessError();
+        }
+        if(!result) {
+            throw TruncatedFile();
+        }
+
+        // Short reads can stop anywhere, even inside a buffer
+        offset += result;
+        for(size_t done = result; done;) {
+            size_t step = min(done, remaining[next].iov_len);
+            remaining[next].iov_base = (char*)remaining[next].iov_base + step;
+            remaining[next].iov_len -= step;
+            done -= step;
+            if(!remaining[next].iov_len) {
+                next++;
+            }
+        }
+    }
+}
+
+ElfCountingSource::ElfCountingSource(ElfSource &source, ElfLoadStats &stats)
+    : source(source), stats(stats), next_offset(0) { }
+
+void ElfCountingSource::read(Elf64_Off offset, size_t size, void *dest) {
+    source.read(offset, size, dest);
+    countRead(offset, size);
+}
+
+void ElfCountingSource::readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count) {
+    source.readScattered(offset, buffers, count);
+    size_t size = 0;
+    for(size_t i = 0; i < count; i++) {
+        size += buffers[i].iov_len;
+    }
+    countRead(offset, size);
+}
+
+void ElfCountingSource::readScatteredBatch(const vector<ElfScatteredRead> &reads) {
+    source.readScatteredBatch(reads);
+    for(const ElfScatteredRead &read : reads) {
+        size_t size = 0;
+        for(const struct iovec &buffer : read.buffers) {
+            size += buffer.iov_len;
+        }
+        countRead(read.offset, size);
+    }
+}
+
+void ElfCountingSource::countRead(Elf64_Off offset, size_t size) {
+    stats.reads++;
+    stats.bytes_read += size;
+    if(offset != next_offset) {
+        stats.seeks++;
+    }
+    next_offset = offset + size;
+}
+
+shared_ptr<const char[]> ElfCountingSource::view(Elf64_Off offset, size_t size) {
+    shared_ptr<const char[]> ptr = source.view(offset, size);
+    if(ptr) {
+        stats.bytes_viewed += size;
+    }
+    return ptr;
+}
+
+bool ElfCountingSource::map(void *address, Elf64_Off offset, size_t size) {
+    bool mapped = source.map(address, offset, size);
+    if(mapped) {
+        stats.bytes_mapped += size;
+    }
+    return mapped;
+}
+
+size_t getPageSize() {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+size_t pageFloor(size_t value) {
+    return value / getPageSize() * getPageSize();
+}
+
+size_t pageCeil(size_t value) {
+    return pageFloor(value + getPageSize() - 1);
+}
+
+shared_ptr<ElfSource> openElfSource(const string &path, const ElfLoadOptions &options) {
+    if(options.io_queue) {
+        return make_shared<ElfQueuedSource>(path, options.io_queue);
+    } else if(options.map_file) {
+        return make_shared<ElfMappedSource>(path);
+    }
+    return make_shared<ElfFileSource>(path);
+}
+
+shared_ptr<ElfSource> openElfSource(int fd, const ElfLoadOptions &options) {
+    if(options.io_queue) {
+        return make_shared<ElfQueuedSource>(fd, options.io_queue);
+    } else if(options.map_file) {
+        return make_shared<ElfMappedSource>(fd);
+    }
+    return make_shared<ElfFileSource>(fd);
+}
@@ -0,0 +1,147 @@
+#ifndef __INC_ELF_SOURCE_H_
+#define __INC_ELF_SOURCE_H_
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include "elf64.h"
+#include "elf_load_options.h"
+#include "elf_load_stats.h"
+
+// A range for ElfSource::readBatch
+struct ElfReadRequest {
+    Elf64_Off offset;
+    size_t size;
+    // The bytes are read straight into `dest` when it's set and into `data` otherwise
+    char *dest;
+    std::shared_ptr<const char[]> data;
+};
+
+// Consecutive bytes starting at `offset` spread over `buffers`
+struct ElfScatteredRead {
+    Elf64_Off offset;
+    std::vector<struct iovec> buffers;
+};
+
+// Where ElfImage gets its bytes from
+class ElfSource {
+public:
+    virtual ~ElfSource() { }
+
+    // Copies `size` bytes starting at `offset` into `dest`
+    virtual void read(Elf64_Off offset, size_t size, void *dest) = 0;
+
+    // Fills `buffers` in order from the bytes starting at `offset`
+    virtual void readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count);
+    // Performs every read, sources which can have several in flight at once override this
+    virtual void readScatteredBatch(const std::vector<ElfScatteredRead> &reads);
+
+    // Serves requests from `view` where possible and reads the rest in file order,
+    // requests close together are merged so each run of them costs one scattered read
+    void readBatch(std::vector<ElfReadRequest> &requests);
+
+    // Returns the bytes at `offset` without copying them
+    // Sources which can only copy return null and callers fall back to `read`
+    virtual std::shared_ptr<const char[]> view(Elf64_Off offset, size_t size);
+
+    // Backs `size` bytes at `address` with the bytes at `offset`
+    // Returns false when the source can't do this and the caller has to `read` instead
+    virtual bool map(void *address, Elf64_Off offset, size_t size);
+
+    // The open file behind the source or -1, it stays the source's and is only good for identifying the file
+    virtual int getFileDescriptor() const { return -1; }
+};
+
+class ElfStreamSource : public ElfSource {
+public:
+    ElfStreamSource(std::istream &is);
+
+    void read(Elf64_Off offset, size_t size, void *dest);
+    void readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count);
+
+private:
+    std::istream &is;
+};
+
+// Bytes already in memory, everything is served as aliases into the buffer
+class ElfBufferSource : public ElfSource {
+public:
+    ElfBufferSource(std::shared_ptr<const char[]> buffer, size_t size);
+
+    void read(Elf64_Off offset, size_t size, void *dest);
+    std::shared_ptr<const char[]> view(Elf64_Off offset, size_t size);
+
+protected:
+    ElfBufferSource();
+
+    void checkRange(Elf64_Off offset, size_t size) const;
+
+    std::shared_ptr<const char[]> buffer;
+    size_t buffer_size;
+};
+
+// Maps the whole file once and serves everything straight from the mapping
+class ElfMappedSource : public ElfBufferSource {
+public:
+    ElfMappedSource(const std::string &path);
+    ElfMappedSource(int fd);
+    ~ElfMappedSource();
+
+    bool map(void *address, Elf64_Off offset, size_t size);
+    int getFileDescriptor() const { return fd; }
+
+private:
+    void mapFile();
+
+    int fd;
+};
+
+// Reads the file with pread and preadv, nothing is mapped and the descriptor's position is never used
+class ElfFileSource : public ElfSource {
+public:
+    ElfFileSource(const std::string &path);
+    ElfFileSource(int fd);
+    ~ElfFileSource();
+
+    void read(Elf64_Off offset, size_t size, void *dest);
+    void readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count);
+    int getFileDescriptor() const { return fd; }
+
+private:
+    int fd;
+};
+
+// Passes everything through to another source and counts it
+class ElfCountingSource : public ElfSource {
+public:
+    ElfCountingSource(ElfSource &source, ElfLoadStats &stats);
+
+    void read(Elf64_Off offset, size_t size, void *dest);
+    void readScattered(Elf64_Off offset, const struct iovec *buffers, size_t count);
+    void readScatteredBatch(const std::vector<ElfScatteredRead> &reads);
+    std::shared_ptr<const char[]> view(Elf64_Off offset, size_t size);
+    bool map(void *address, Elf64_Off offset, size_t size);
+    int getFileDescriptor() const { return source.getFileDescriptor(); }
+
+private:
+    void countRead(Elf64_Off offset, size_t size);
+
+    ElfSource &source;
+    ElfLoadStats &stats;
+    Elf64_Off next_offset;
+};
+
+// The source ElfImage reads a file through, picked by `io_queue` and `map_file`
+std::shared_ptr<ElfSource> openElfSource(const std::string &path, const ElfLoadOptions &options);
+std::shared_ptr<ElfSource> openElfSource(int fd, const ElfLoadOptions &options);
+
+// preadv until every buffer is full, throws TruncatedFile at the end of the file
+void readFileScattered(int fd, Elf64_Off offset, const struct iovec *buffers, size_t count);
+
+size_t getPageSize();
+size_t pageFloor(size_t value);
+size_t pageCeil(size_t value);
+
+#endif//__INC_ELF_SOURCE_H_
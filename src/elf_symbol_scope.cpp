@@ -0,0 +1,77 @@
+#include <cstring>
+#include <mutex>
+#include "exceptions.h"
+#include "elf_hash.h"
+#include "elf_image.h"
+#include "elf_symbol_scope.h"
+using namespace std;
+
+ElfSymbolScope::ElfSymbolScope(const Shims &shims) : shims(shims) {
+    this->shims.freeze();
+}
+
+void ElfSymbolScope::addImage(const ElfImage *image) {
+    // Cached names already resolved to an earlier definition and appending can't change that
+    unique_lock<shared_mutex> lock(images_mutex);
+    images.push_back(image);
+}
+
+vector<const ElfImage*> ElfSymbolScope::getImages() const {
+    shared_lock<shared_mutex> lock(images_mutex);
+    return images;
+}
+
+bool ElfSymbolScope::find(const char *name, const void *&address) {
+    uint32_t hash = elfGnuHash(name);
+    CacheShard &shard = shards[(hash >> 24) % shard_count];
+
+    {
+        shared_lock<shared_mutex> lock(shard.mutex);
+        auto range = shard.symbols.equal_range(hash);
+        for(auto iterator = range.first; iterator != range.second; iterator++) {
+            if(!strcmp(iterator->second.name.c_str(), name)) {
+                address = iterator->second.address;
+                return true;
+            }
+        }
+    }
+
+    // Misses aren't cached, an image added later might still define them
+    if(!findUncached(name, hash, address)) {
+        return false;
+    }
+
+    // Two threads may resolve the same name at once, they get the same answer so keeping either is fine
+    unique_lock<shared_mutex> lock(shard.mutex);
+    auto range = shard.symbols.equal_range(hash);
+    for(auto iterator = range.first; iterator != range.second; iterator++) {
+        if(!strcmp(iterator->second.name.c_str(), name)) {
+            return true;
+        }
+    }
+    shard.symbols.emplace(hash, CachedSymbol{name, address});
+    return true;
+}
+
+const void *ElfSymbolScope::resolve(const char *name) {
+    const void *address;
+    if(!find(name, address)) {
+        throw UnresolvedSymbol(name);
+    }
+    return address;
+}
+
+bool ElfSymbolScope::findUncached(const char *name, uint32_t hash, const void *&address) const {
+    if(shims.find(name, hash, address)) {
+        return true;
+    }
+
+    shared_lock<shared_mutex> lock(images_mutex);
+    for(const ElfImage *image : images) {
+        address = image->getExportedSymbolAddress(name, hash);
+        if(address) {
+            return true;
+        }
+    }
+    return false;
+}
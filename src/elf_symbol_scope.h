@@ -0,0 +1,59 @@
+#ifndef __INC_ELF_SYMBOL_SCOPE_H_
+#define __INC_ELF_SYMBOL_SCOPE_H_
+
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "elf_shim_table.h"
+
+class ElfImage;
+
+// What every module in a load resolves its imports against
+// Like the dynamic linker's global scope the host's shims come first and then images in load order,
+// the first definition wins so earlier images interpose on later ones
+// Images only contribute what they export, their locals and hidden symbols stay private
+class ElfSymbolScope {
+public:
+    typedef ElfShimTable Shims;
+
+    // Keeps a frozen copy of `shims`, that's free when they're frozen already
+    ElfSymbolScope(const Shims &shims);
+
+    // Images aren't owned so they have to outlive the scope or at least every lookup through it
+    void addImage(const ElfImage *image);
+
+    // Returns false when nothing in the scope defines `name`, shims may legitimately resolve to null
+    bool find(const char *name, const void *&address);
+    // Same but throws UnresolvedSymbol
+    const void *resolve(const char *name);
+
+    const Shims &getShims() const { return shims; }
+    std::vector<const ElfImage*> getImages() const;
+
+private:
+    struct CachedSymbol {
+        std::string name;
+        const void *address;
+    };
+
+    // Resolved names are memoised by hash across every module using the scope
+    // Sharding keeps relocation threads from contending on one lock
+    struct CacheShard {
+        std::shared_mutex mutex;
+        std::unordered_multimap<uint32_t, CachedSymbol> symbols;
+    };
+    static constexpr size_t shard_count = 16;
+
+    bool findUncached(const char *name, uint32_t hash, const void *&address) const;
+
+    Shims shims;
+
+    mutable std::shared_mutex images_mutex;
+    std::vector<const ElfImage*> images;
+
+    CacheShard shards[shard_count];
+};
+
+#endif//__INC_ELF_SYMBOL_SCOPE_H_
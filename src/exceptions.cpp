@@ -17,3 +17,11 @@ UnresolvedSymbol::UnresolvedSymbol(const std::string &name) {
     strcpy(msg, prefix);
     strcat(msg, name_str);
 }
+
+UnresolvedLibrary::UnresolvedLibrary(const std::string &name) {
+    static const char *prefix = "Unresolved library: ";
+    const char *name_str = name.c_str();
+    msg = new char[strlen(prefix) + strlen(name_str) + 1];
+    strcpy(msg, prefix);
+    strcat(msg, name_str);
+}
@@ -27,6 +27,20 @@ public:
     }
 };
 
+class UnalignedSegment : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "Segment address and offset are not page aligned";
+    }
+};
+
+class UnsupportedElfClass : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "Only 64 bit ELF files are supported";
+    }
+};
+
 class UnsupportedSectionConfiguration : public ElfLoaderException {
 public:
     const char *what() const noexcept {
@@ -48,6 +62,55 @@ public:
     }
 };
 
+class FileAccessError : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "Could not open or map file";
+    }
+};
+
+class TruncatedFile : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "File is shorter than its headers describe";
+    }
+};
+
+class AddressSpaceError : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "Could not reserve address space for image";
+    }
+};
+
+class ProtectionError : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "Could not change memory protection of image";
+    }
+};
+
+class FrozenShimTable : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "Shim table is frozen";
+    }
+};
+
+class AsyncIoUnavailable : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "io_uring is not available";
+    }
+};
+
+class LoadCancelled : public ElfLoaderException {
+public:
+    const char *what() const noexcept {
+        return "Load was cancelled";
+    }
+};
+
 class UnexpectedRelocationType : public ElfLoaderException {
 public:
     UnexpectedRelocationType(const std::string &type);
@@ -72,4 +135,16 @@ private:
     char *msg;
 };
 
+class UnresolvedLibrary : public ElfLoaderException {
+public:
+    UnresolvedLibrary(const std::string &name);
+
+    const char *what() const noexcept {
+        return msg;
+    }
+
+private:
+    char *msg;
+};
+
 #endif//__INC_EXCEPTIONS_H_
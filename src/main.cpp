@@ -1,7 +1,5 @@
 #include <iostream>
-#include <fstream>
 #include "elf_module.h"
-#include "mprotect.h"
 using namespace std;
 
 SYSV int printWrapper(const char *str) {
@@ -14,10 +12,6 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    ifstream ifs;
-    ifs.exceptions(ifstream::eofbit | ifstream::failbit | ifstream::badbit);
-    ifs.open(argv[1], ios_base::in | ios_base::binary);
-
     ElfModule::DynamicShims shims;
 
     // I'm relatively sure these can all be null
@@ -28,10 +22,7 @@ int main(int argc, char *argv[]) {
     shims["__cxa_finalize"] = nullptr;
 
     shims["printf"] = (const void*)printWrapper;
-    ElfModule library(shims, ifs);
-
-    // FIXME: Do this at allocation time
-    unprotect(library.getImageBase(), 0x5000);
+    ElfModule library(shims, string(argv[1]));
 
     const void *example_function_addr = library.getSymbolAddress(argv[2]);
 
@@ -0,0 +1,35 @@
+#include "thread_pool.h"
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threads) : stopping(false) {
+    for(unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(tasks_mutex);
+        stopping = true;
+    }
+    tasks_ready.notify_all();
+    for(thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::work() {
+    while(true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(tasks_mutex);
+            tasks_ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if(tasks.empty()) {
+                return;
+            }
+            task = move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
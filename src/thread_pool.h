@@ -0,0 +1,45 @@
+#ifndef __INC_THREAD_POOL_H_
+#define __INC_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers pulling tasks off a shared queue
+class ThreadPool {
+public:
+    ThreadPool(unsigned threads);
+    // Finishes every queued task before joining
+    ~ThreadPool();
+
+    template <typename Function>
+    std::future<decltype(std::declval<Function>()())> submit(Function function) {
+        typedef decltype(function()) Result;
+        std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(function);
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(tasks_mutex);
+            tasks.push([task]() { (*task)(); });
+        }
+        tasks_ready.notify_one();
+        return result;
+    }
+
+    unsigned getThreadCount() const { return workers.size(); }
+
+private:
+    void work();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex tasks_mutex;
+    std::condition_variable tasks_ready;
+    bool stopping;
+};
+
+#endif//__INC_THREAD_POOL_H_
@@ -0,0 +1,36 @@
+#include <cstring>
+#include <string>
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks addresses inside a function map back to it, for exported and hidden functions alike
+
+static bool findsEvery(const ElfModule &module, const char *prefix) {
+    bool all_found = true;
+    for(int i = 10; i < 50; i++) {
+        string name = prefix + to_string(i);
+        const char *start = (const char*)module.getSymbolAddress(name);
+        ElfSymbolLocation location;
+        all_found &= start && module.findSymbolAt(start + 4, location)
+            && !strcmp(location.name, name.c_str())
+            && location.symbol_offset == (Elf64_Addr)(start - (const char*)module.getImageBase())
+            && location.offset == 4;
+    }
+    return all_found;
+}
+
+void testAddress(const string &directory) {
+    ElfModule::DynamicShims shims;
+    ElfModule exported(shims, directory + "/libhash.so");
+    check(findsEvery(exported, "hash_export_"), "addresses inside exported functions map back to them");
+    ElfModule hidden(shims, directory + "/libsymtab.so");
+    check(findsEvery(hidden, "symtab_hidden_"), "addresses inside hidden functions map back to them");
+
+    ElfSymbolLocation location;
+    check(!exported.findSymbolAt(exported.getImageBase(), location), "the ELF header isn't inside any symbol");
+    check(
+        !exported.findSymbolAt((const char*)exported.getImageBase() + exported.getImageSize(), location),
+        "addresses past the image aren't inside any symbol"
+    );
+}
@@ -0,0 +1,66 @@
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "exceptions.h"
+#include "elf_cancel_token.h"
+#include "elf_module_loader.h"
+#include "test.h"
+using namespace std;
+
+// Checks loadAsync hands out initialized modules and that cancelling stops a load before any constructor runs
+
+typedef SYSV int (*ValueFunction)();
+
+static bool loadCancelled(future<shared_ptr<ElfModule>> &result) {
+    try {
+        result.get();
+    } catch(const LoadCancelled&) {
+        return true;
+    }
+    return false;
+}
+
+void testAsync(const string &directory) {
+    takeGraphEvents();
+    {
+        ElfModuleLoader loader(getGraphShims());
+        loader.addSearchPath(directory);
+        shared_ptr<ElfModule> called;
+        auto result = loader.loadAsync(directory + "/libgraph-root.so", [&](shared_ptr<ElfModule> module, exception_ptr) {
+            called = module;
+        });
+        shared_ptr<ElfModule> root = result.get();
+        check(root && called == root, "the callback gets the module the future does");
+        check(((ValueFunction)root->getSymbolAddress("root_value"))() == 42, "an async load is initialized");
+    }
+    takeGraphEvents();
+
+    {
+        ElfModuleLoader loader(getGraphShims());
+        loader.addSearchPath(directory);
+        auto token = make_shared<ElfCancelToken>();
+        token->cancel();
+        auto result = loader.loadAsync(directory + "/libgraph-root.so", nullptr, token);
+        check(loadCancelled(result), "a load cancelled up front throws LoadCancelled");
+    }
+
+    {
+        // Cancelled once the root, which is relocated last, is done so only the initializers are left
+        auto token = make_shared<ElfCancelToken>();
+        atomic<int> relocated(0);
+        ElfLoadOptions options;
+        options.stats_callback = [&](const ElfLoadStats&) {
+            if(++relocated == 2) {
+                token->cancel();
+            }
+        };
+        ElfModuleLoader loader(getGraphShims(), options);
+        loader.addSearchPath(directory);
+        auto result = loader.loadAsync(directory + "/libgraph-root.so", nullptr, token);
+        check(loadCancelled(result), "a load cancelled after relocation throws LoadCancelled");
+    }
+    check(takeGraphEvents().empty(), "cancelled loads never run a constructor or destructor");
+}
@@ -0,0 +1,46 @@
+#include <string>
+#include <vector>
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks batch lookups agree with single lookups, through either hash table and through the .symtab index
+
+static void checkBatch(const string &path, const char *prefix, const char *description) {
+    ElfModule::DynamicShims shims;
+    ElfModule module(shims, path);
+
+    // Every other name misses
+    vector<string> names;
+    for(int i = 10; i < 50; i++) {
+        names.push_back(prefix + to_string(i));
+        names.push_back(prefix + to_string(i + 50));
+    }
+    ElfImportList imports(names);
+    vector<const void*> addresses(names.size());
+    size_t found = module.getSymbolAddresses(imports, addresses.data());
+
+    bool agree = true;
+    for(size_t i = 0; i < names.size(); i++) {
+        agree &= addresses[i] == module.getSymbolAddress(names[i]) && (addresses[i] == nullptr) == (i % 2 == 1);
+    }
+    check(found == names.size() / 2 && agree, description);
+}
+
+void testBatch(const string &directory) {
+    checkBatch(directory + "/libhash.so", "hash_export_", "a batch agrees with single lookups through the GNU hash table");
+    checkBatch(
+        directory + "/libhash-sysv.so", "hash_export_", "a batch agrees with single lookups through the SysV hash table"
+    );
+    checkBatch(directory + "/libsymtab.so", "symtab_hidden_", "a batch agrees with single lookups through .symtab");
+
+    ElfModule::DynamicShims shims;
+    ElfModule module(shims, directory + "/libhash.so");
+    const char *const names[] = {"hash_export_10", "hash_export_1"};
+    const void *addresses[2];
+    check(
+        module.getSymbolAddresses(names, 2, addresses) == 1 && addresses[0] == module.getSymbolAddress(names[0])
+            && !addresses[1],
+        "a batch of plain names resolves like an import list"
+    );
+}
@@ -0,0 +1,49 @@
+#include <cstring>
+#include <memory>
+#include <string>
+#include "elf_image.h"
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks .bss comes up zeroed without clearing any of a following segment
+
+typedef SYSV int (*ValueFunction)();
+
+void testBss(const string &directory) {
+    ElfModule::DynamicShims shims;
+    ElfModule module(shims, directory + "/libbss.so");
+    check(((ValueFunction)module.getSymbolAddress("bss_value"))() == 3, ".bss is zero and .data is intact");
+
+    size_t size;
+    shared_ptr<char[]> buffer = readFile(directory + "/libbss.so", size);
+
+    // Gives the segment before the last one .bss ending a few bytes into the page the last one starts in
+    const Elf64_Ehdr *elf_header = (const Elf64_Ehdr*)buffer.get();
+    Elf64_Phdr *program_headers = (Elf64_Phdr*)&buffer[elf_header->e_phoff];
+    Elf64_Phdr *previous = nullptr;
+    Elf64_Phdr *last = nullptr;
+    for(int i = 0; i < elf_header->e_phnum; i++) {
+        if(program_headers[i].p_type == PT_LOAD) {
+            previous = last;
+            last = &program_headers[i];
+        }
+    }
+    Elf64_Addr shared_page = pageFloor(last->p_vaddr);
+    if(!previous || shared_page == last->p_vaddr || previous->p_vaddr + previous->p_filesz > shared_page) {
+        check(false, "the fixture's last segment shares its first page");
+        return;
+    }
+    previous->p_memsz = shared_page + sizeof(Elf64_Xword) - previous->p_vaddr;
+
+    ElfImage image(buffer, size);
+    const char *start = (const char*)image.getImageBase() + last->p_vaddr;
+    check(
+        !memcmp(start, &buffer[last->p_offset], pageCeil(last->p_vaddr) - last->p_vaddr),
+        ".bss ending in the next segment's first page leaves that segment's contents alone"
+    );
+    check(
+        *(const Elf64_Xword*)((const char*)image.getImageBase() + shared_page) == 0,
+        ".bss in the next segment's first page is still zeroed"
+    );
+}
@@ -0,0 +1,46 @@
+#include <cstring>
+#include <memory>
+#include <string>
+#include "exceptions.h"
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks modules load from memory, with the module sharing the buffer or the caller keeping it alive
+
+typedef SYSV int (*ValueFunction)();
+
+void testBuffer(const string &directory) {
+    ElfModule::DynamicShims shims;
+    size_t size;
+    shared_ptr<char[]> contents = readFile(directory + "/libhash.so", size);
+
+    shared_ptr<const char[]> shared(new char[size]);
+    memcpy((char*)shared.get(), contents.get(), size);
+    ElfModule module(shims, shared, size);
+    // Sections alias the buffer so the module has to hold on to it
+    shared.reset();
+    ValueFunction function = (ValueFunction)module.getSymbolAddress("hash_export_10");
+    check(function && function() == 10, "a module loads from a buffer it shares");
+
+    ElfModule borrowed(shims, (const void*)contents.get(), size);
+    function = (ValueFunction)borrowed.getSymbolAddress("hash_export_49");
+    check(function && function() == 49, "a module loads from a buffer the caller keeps");
+
+    bool truncated = false;
+    try {
+        ElfModule module(shims, (const void*)contents.get(), size / 2);
+    } catch(const TruncatedFile&) {
+        truncated = true;
+    }
+    check(truncated, "a buffer cut short throws TruncatedFile");
+
+    bool invalid = false;
+    shared_ptr<char[]> zeros(new char[size]());
+    try {
+        ElfModule module(shims, (const void*)zeros.get(), size);
+    } catch(const InvalidSignature&) {
+        invalid = true;
+    }
+    check(invalid, "a buffer which isn't ELF throws InvalidSignature");
+}
@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <dirent.h>
+#include <unistd.h>
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks a module restored from the cache is rebased and has its symbols resolved in the process restoring it
+
+typedef SYSV int (*ValueFunction)();
+
+static SYSV int importOne() {
+    return 1;
+}
+
+static SYSV int importTwo() {
+    return 2;
+}
+
+static shared_ptr<ElfModule> loadCached(const string &path, const string &cache_directory, SYSV int (*import)()) {
+    ElfModule::DynamicShims shims;
+    shims["cache_import"] = (const void*)import;
+    ElfLoadOptions options;
+    options.cache_directory = cache_directory;
+    options.collect_stats = true;
+    return make_shared<ElfModule>(shims, path, options);
+}
+
+static bool wasRestored(const ElfModule &module) {
+    return module.getLoadStats()->relocation_counts.empty();
+}
+
+static string findEntry(const string &directory) {
+    string entry;
+    DIR *dir = opendir(directory.c_str());
+    while(struct dirent *file = readdir(dir)) {
+        if(file->d_name[0] != '.') {
+            entry = directory + "/" + file->d_name;
+        }
+    }
+    closedir(dir);
+    return entry;
+}
+
+void testCache(const string &directory) {
+    char cache_directory[] = "/tmp/elf-loader-cache-XXXXXX";
+    if(!mkdtemp(cache_directory)) {
+        check(false, "a cache directory can be created");
+        return;
+    }
+    string path = directory + "/libcache.so";
+
+    shared_ptr<ElfModule> stored = loadCached(path, cache_directory, importOne);
+    check(!wasRestored(*stored), "the first load relocates");
+    check(((ValueFunction)stored->getSymbolAddress("cache_value"))() == 6, "the first load works");
+    string entry = findEntry(cache_directory);
+    check(!entry.empty(), "the first load stores an entry");
+
+    // Loaded while the first is still mapped so it can't end up at the same base
+    shared_ptr<ElfModule> restored = loadCached(path, cache_directory, importTwo);
+    check(wasRestored(*restored), "the second load is restored");
+    check(restored->getImageBase() != stored->getImageBase(), "the restored module is somewhere else");
+    check(
+        ((ValueFunction)restored->getSymbolAddress("cache_value"))() == 7,
+        "the restored module is rebased and calls this load's shims"
+    );
+
+    restored.reset();
+    if(!entry.empty()) {
+        truncate(entry.c_str(), 64);
+    }
+    shared_ptr<ElfModule> relocated = loadCached(path, cache_directory, importTwo);
+    check(!wasRestored(*relocated), "a truncated entry is relocated again");
+    check(((ValueFunction)relocated->getSymbolAddress("cache_value"))() == 7, "the module relocated again works");
+
+    unlink(findEntry(cache_directory).c_str());
+    rmdir(cache_directory);
+}
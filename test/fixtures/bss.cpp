@@ -0,0 +1,13 @@
+// Enough .bss to need whole zero pages past the last file page
+
+static char zeros[4 * 4096];
+static int value = 3;
+
+extern "C" int bss_value() {
+    for(unsigned i = 0; i < sizeof(zeros); i++) {
+        if(zeros[i]) {
+            return 0;
+        }
+    }
+    return value;
+}
@@ -0,0 +1,10 @@
+// A pointer into the image and a call out of it, a restored copy has to rebase the one and resolve the other again
+
+extern "C" int cache_import();
+
+static int value = 5;
+int *value_pointer = &value;
+
+extern "C" int cache_value() {
+    return *value_pointer + cache_import();
+}
@@ -0,0 +1,18 @@
+// Only gives the right value once its constructor ran, records both ends of its life with the host
+
+extern "C" void record_event(int event);
+
+static int value = 5;
+
+__attribute__((constructor)) static void construct() {
+    value = 42;
+    record_event(1);
+}
+
+__attribute__((destructor)) static void destruct() {
+    record_event(-1);
+}
+
+extern "C" int dep_value() {
+    return value;
+}
@@ -0,0 +1,19 @@
+// Needs test/fixtures/graph-dep.cpp, its constructor runs after the dependency's
+
+extern "C" void record_event(int event);
+extern "C" int dep_value();
+
+static int value = 0;
+
+__attribute__((constructor)) static void construct() {
+    value = dep_value();
+    record_event(2);
+}
+
+__attribute__((destructor)) static void destruct() {
+    record_event(-2);
+}
+
+extern "C" int root_value() {
+    return value;
+}
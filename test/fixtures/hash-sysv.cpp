@@ -0,0 +1,3 @@
+// The same exports as hash.cpp with only a SysV hash table
+
+#include "hash.cpp"
@@ -0,0 +1,11 @@
+// Enough exports that the hash tables have several buckets and chains, each returns its own number
+
+#define EXPORT(n) extern "C" int hash_export_##n() { return n; }
+#define EXPORT_TEN(tens) \
+    EXPORT(tens##0) EXPORT(tens##1) EXPORT(tens##2) EXPORT(tens##3) EXPORT(tens##4) \
+    EXPORT(tens##5) EXPORT(tens##6) EXPORT(tens##7) EXPORT(tens##8) EXPORT(tens##9)
+
+EXPORT_TEN(1)
+EXPORT_TEN(2)
+EXPORT_TEN(3)
+EXPORT_TEN(4)
@@ -0,0 +1,22 @@
+// Calls through the PLT with every argument register in use, the first call to each goes through the lazy binding
+// trampoline so all of them have to survive binding
+
+typedef double Vector __attribute__((vector_size(32)));
+
+extern "C" double lazy_mix(long a, long b, long c, long d, long e, long f, double x, double y);
+extern "C" __attribute__((target("avx"))) double lazy_sum(Vector v);
+// Never called, only binding it would fail
+extern "C" void lazy_missing();
+
+extern "C" double lazy_call_mix() {
+    return lazy_mix(1, 2, 3, 4, 5, 6, 0.5, 0.25);
+}
+
+extern "C" __attribute__((target("avx"))) double lazy_call_sum() {
+    Vector v = {1, 2, 3, 4};
+    return lazy_sum(v);
+}
+
+extern "C" void lazy_call_missing() {
+    lazy_missing();
+}
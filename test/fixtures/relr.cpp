@@ -0,0 +1,22 @@
+// Pointers into the image which only DT_RELR relocates
+// The long run needs several bitmap words and the pointer past the gap needs its own address entry
+
+static int values[100];
+
+#define POINTERS_4(n) &values[n], &values[n + 1], &values[n + 2], &values[n + 3]
+#define POINTERS_20(n) POINTERS_4(n), POINTERS_4(n + 4), POINTERS_4(n + 8), POINTERS_4(n + 12), POINTERS_4(n + 16)
+
+static struct {
+    int *run[100];
+    long gap[1024];
+    int *lone;
+} pointers = {{POINTERS_20(0), POINTERS_20(20), POINTERS_20(40), POINTERS_20(60), POINTERS_20(80)}, {1}, &values[7]};
+
+// How many of the pointers are right, 101 once everything is relocated
+extern "C" int relr_correct() {
+    int correct = pointers.lone == &values[7];
+    for(int i = 0; i < 100; i++) {
+        correct += pointers.run[i] == &values[i];
+    }
+    return correct;
+}
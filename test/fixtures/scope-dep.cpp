@@ -0,0 +1,15 @@
+// Defines `helper` in .symtab only and `hidden_fn` with hidden visibility, neither may satisfy another module's import
+
+extern "C" {
+    static int __attribute__((noinline, used)) helper() {
+        return 1;
+    }
+}
+
+extern "C" __attribute__((visibility("hidden"), noinline)) int hidden_fn() {
+    return 2;
+}
+
+extern "C" int dep_value() {
+    return helper() + hidden_fn();
+}
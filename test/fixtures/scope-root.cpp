@@ -0,0 +1,13 @@
+// Imports the same names test/fixtures/scope-dep.cpp keeps private, only `dep_value` can resolve
+
+extern "C" int dep_value();
+extern "C" int helper();
+extern "C" int hidden_fn();
+
+extern "C" int root_value() {
+    return dep_value();
+}
+
+extern "C" int root_private() {
+    return helper() + hidden_fn();
+}
@@ -0,0 +1,11 @@
+// Hidden definitions only .symtab lists, that table has no hash table from the linker
+
+#define HIDDEN(n) extern "C" __attribute__((visibility("hidden"))) int symtab_hidden_##n() { return n; }
+#define HIDDEN_TEN(tens) \
+    HIDDEN(tens##0) HIDDEN(tens##1) HIDDEN(tens##2) HIDDEN(tens##3) HIDDEN(tens##4) \
+    HIDDEN(tens##5) HIDDEN(tens##6) HIDDEN(tens##7) HIDDEN(tens##8) HIDDEN(tens##9)
+
+HIDDEN_TEN(1)
+HIDDEN_TEN(2)
+HIDDEN_TEN(3)
+HIDDEN_TEN(4)
@@ -0,0 +1,42 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include "elf_module.h"
+#include "elf_module_loader.h"
+#include "test.h"
+using namespace std;
+
+// Checks a dependency graph is initialized dependencies first and finalized the other way round
+
+typedef SYSV int (*ValueFunction)();
+
+static vector<int> events;
+
+static SYSV void recordEvent(int event) {
+    events.push_back(event);
+}
+
+ElfModule::DynamicShims getGraphShims() {
+    ElfModule::DynamicShims shims;
+    shims["record_event"] = (const void*)recordEvent;
+    return shims;
+}
+
+vector<int> takeGraphEvents() {
+    vector<int> taken;
+    taken.swap(events);
+    return taken;
+}
+
+void testGraph(const string &directory) {
+    ElfModuleLoader loader(getGraphShims());
+    loader.addSearchPath(directory);
+    takeGraphEvents();
+
+    shared_ptr<ElfModule> root = loader.load(directory + "/libgraph-root.so");
+    check(takeGraphEvents() == vector<int>({1, 2}), "constructors run dependencies first");
+    check(((ValueFunction)root->getSymbolAddress("root_value"))() == 42, "the root sees its dependency initialized");
+
+    root.reset();
+    check(takeGraphEvents() == vector<int>({-2, -1}), "destructors run dependents first once the root goes");
+}
@@ -0,0 +1,52 @@
+#include <string>
+#include "elf_header_view.h"
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks lookups through the GNU and the SysV hash table find every export and nothing else
+// .dynsym alone is searched so nothing can fall back to scanning .symtab
+
+typedef SYSV int (*ValueFunction)();
+
+static bool hasDynamicEntry(const string &path, Elf64_Sxword tag) {
+    ElfHeaderView view(path);
+    for(const Elf64_Dyn &entry : view.getDynamicEntries()) {
+        if(entry.d_tag == tag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void checkLookups(const string &path, const char *table) {
+    ElfModule::DynamicShims shims;
+    ElfModule module(shims, path);
+    bool all_found = true;
+    for(int i = 10; i < 50; i++) {
+        string name = "hash_export_" + to_string(i);
+        ValueFunction function = (ValueFunction)module.getExportedSymbolAddress(name.c_str(), elfGnuHash(name.c_str()));
+        all_found &= function && function() == i;
+    }
+    check(all_found, (string("every export is found through the ") + table + " hash table").c_str());
+    check(
+        !module.getExportedSymbolAddress("hash_export_50", elfGnuHash("hash_export_50"))
+            && !module.getExportedSymbolAddress("hash_export_1", elfGnuHash("hash_export_1")),
+        (string("names which aren't exported miss the ") + table + " hash table").c_str()
+    );
+}
+
+void testHash(const string &directory) {
+    string gnu_path = directory + "/libhash.so";
+    string sysv_path = directory + "/libhash-sysv.so";
+    check(
+        hasDynamicEntry(gnu_path, DT_GNU_HASH) && !hasDynamicEntry(gnu_path, DT_HASH),
+        "the GNU fixture only has a GNU hash table"
+    );
+    check(
+        hasDynamicEntry(sysv_path, DT_HASH) && !hasDynamicEntry(sysv_path, DT_GNU_HASH),
+        "the SysV fixture only has a SysV hash table"
+    );
+    checkLookups(gnu_path, "GNU");
+    checkLookups(sysv_path, "SysV");
+}
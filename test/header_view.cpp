@@ -0,0 +1,49 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "exceptions.h"
+#include "elf_header_view.h"
+#include "test.h"
+using namespace std;
+
+// Checks the headers-only view reports what a file links against and exports, however the file is read
+
+static bool describesGraphRoot(const ElfHeaderView &view) {
+    return view.getMachine() == EM_X86_64
+        && view.getSoname() == "libgraph-root.so"
+        && view.getNeededLibraries() == vector<string>({"libgraph-dep.so"});
+}
+
+void testHeaderView(const string &directory) {
+    string path = directory + "/libgraph-root.so";
+    check(describesGraphRoot(ElfHeaderView(path)), "a mapped file reports its soname and DT_NEEDED");
+
+    ElfLoadOptions options;
+    options.map_file = false;
+    check(describesGraphRoot(ElfHeaderView(path, options)), "a file read with pread reports the same");
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    check(fd >= 0 && describesGraphRoot(ElfHeaderView(fd)), "a descriptor reports the same");
+    close(fd);
+
+    size_t size;
+    shared_ptr<char[]> contents = readFile(path, size);
+    check(describesGraphRoot(ElfHeaderView(contents, size)), "a buffer reports the same");
+
+    ElfHeaderView exports(directory + "/libhash.so");
+    check(
+        exports.getExportedSymbolCount() == 40 && exports.getNeededLibraries().empty() && exports.getSoname() == "libhash.so",
+        "exports are counted without loading the file"
+    );
+
+    bool invalid = false;
+    shared_ptr<char[]> zeros(new char[size]());
+    try {
+        ElfHeaderView view(zeros, size);
+    } catch(const InvalidSignature&) {
+        invalid = true;
+    }
+    check(invalid, "a buffer which isn't ELF throws InvalidSignature");
+}
@@ -0,0 +1,49 @@
+#include <string>
+#include "exceptions.h"
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks PLT slots are bound on their first call and the arguments in flight, vector registers included, survive it
+
+typedef double Vector __attribute__((vector_size(32)));
+typedef SYSV double (*DoubleFunction)();
+
+static SYSV double lazyMix(long a, long b, long c, long d, long e, long f, double x, double y) {
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + x + y;
+}
+
+// Binding may run library code which clears the upper halves, that would leave 3
+static SYSV __attribute__((target("avx"))) double lazySum(Vector v) {
+    return v[0] + v[1] + v[2] + v[3];
+}
+
+void testLazy(const string &directory) {
+    string path = directory + "/liblazy.so";
+    ElfModule::DynamicShims shims;
+    shims["lazy_mix"] = (const void*)lazyMix;
+    shims["lazy_sum"] = (const void*)lazySum;
+
+    bool unresolved = false;
+    try {
+        ElfModule eager(shims, path);
+    } catch(const UnresolvedSymbol&) {
+        unresolved = true;
+    }
+    check(unresolved, "binding eagerly fails on the import that has no shim");
+
+    ElfLoadOptions options;
+    options.lazy_binding = true;
+    // Throws like the eager load if the import without a shim were bound up front
+    ElfModule module(shims, path, options);
+
+    DoubleFunction call_mix = (DoubleFunction)module.getSymbolAddress("lazy_call_mix");
+    check(call_mix() == 91.75, "integer and floating point arguments survive binding");
+    check(call_mix() == 91.75, "the bound slot calls the shim directly");
+    if(__builtin_cpu_supports("avx")) {
+        check(
+            ((DoubleFunction)module.getSymbolAddress("lazy_call_sum"))() == 10,
+            "all of a 256 bit vector argument survives binding"
+        );
+    }
+}
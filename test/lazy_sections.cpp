@@ -0,0 +1,50 @@
+#include <fstream>
+#include <string>
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks `lazy_sections` leaves .symtab out of the load and still finds everything in it afterwards
+
+typedef SYSV int (*ValueFunction)();
+
+static uint64_t getBytesLoaded(const ElfModule &module) {
+    const ElfLoadStats *stats = module.getLoadStats();
+    return stats->bytes_read + stats->bytes_viewed + stats->bytes_mapped;
+}
+
+void testLazySections(const string &directory) {
+    string path = directory + "/libsymtab.so";
+    ElfModule::DynamicShims shims;
+    ElfLoadOptions options;
+    options.collect_stats = true;
+    ElfModule eager(shims, path, options);
+    options.lazy_sections = true;
+    ElfModule lazy(shims, path, options);
+    check(getBytesLoaded(lazy) < getBytesLoaded(eager), "loading with lazy_sections reads less");
+
+    // Each kind of lookup gets a module whose .symtab hasn't been read yet
+    ValueFunction function = (ValueFunction)lazy.getSymbolAddress("symtab_hidden_10");
+    check(function && function() == 10, "a lookup missing .dynsym reads .symtab");
+    Elf64_Addr offset = (const char*)function - (const char*)lazy.getImageBase();
+
+    ElfModule batch(shims, path, options);
+    const char *const names[] = {"symtab_hidden_10", "symtab_hidden_49"};
+    const void *addresses[2];
+    check(
+        batch.getSymbolAddresses(names, 2, addresses) == 2 && addresses[0] == (const char*)batch.getImageBase() + offset,
+        "batch lookups read .symtab too"
+    );
+
+    ElfModule index(shims, path, options);
+    ElfSymbolLocation location;
+    check(
+        index.findSymbolAt((const char*)index.getImageBase() + offset, location) && string(location.name) == names[0],
+        "the address index reads .symtab too"
+    );
+
+    ifstream stream(path, ios::binary);
+    ElfModule streamed(shims, stream, options);
+    function = (ValueFunction)streamed.getSymbolAddress("symtab_hidden_49");
+    check(function && function() == 49, "an image from a stream loads .symtab up front instead");
+}
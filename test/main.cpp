@@ -0,0 +1,69 @@
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <string>
+#include "test.h"
+using namespace std;
+
+// Runs every test against the libraries built from test/fixtures
+
+static int failures = 0;
+
+void check(bool condition, const char *description) {
+    printf("%s: %s\n", condition ? "pass" : "FAIL", description);
+    if(!condition) {
+        failures++;
+    }
+}
+
+shared_ptr<char[]> readFile(const string &path, size_t &size) {
+    ifstream file(path, ios::binary | ios::ate);
+    size = file.tellg();
+    shared_ptr<char[]> contents(new char[size]);
+    file.seekg(0);
+    file.read(contents.get(), size);
+    return contents;
+}
+
+struct Test {
+    const char *name;
+    void (*run)(const string &directory);
+};
+
+static const Test tests[] = {
+    {"scope", testScope},
+    {"graph", testGraph},
+    {"async", testAsync},
+    {"registry", testRegistry},
+    {"cache", testCache},
+    {"bss", testBss},
+    {"shims", testShims},
+    {"hash", testHash},
+    {"symtab", testSymtab},
+    {"relr", testRelr},
+    {"lazy", testLazy},
+    {"buffer", testBuffer},
+    {"batch", testBatch},
+    {"address", testAddress},
+    {"lazy_sections", testLazySections},
+    {"header_view", testHeaderView},
+};
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s <test-libs directory>\n", argv[0]);
+        return 1;
+    }
+
+    for(const Test &test : tests) {
+        printf("%s\n", test.name);
+        try {
+            test.run(argv[1]);
+        } catch(const exception &error) {
+            check(false, error.what());
+        }
+    }
+    printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
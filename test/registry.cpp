@@ -0,0 +1,47 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include "elf_module_loader.h"
+#include "elf_module_registry.h"
+#include "test.h"
+using namespace std;
+
+// Checks the registry shares modules between loads and finalizes each exactly once
+
+typedef SYSV int (*ValueFunction)();
+
+static SYSV int fallbackValue() {
+    return 7;
+}
+
+void testRegistry(const string &directory) {
+    ElfModuleRegistry &registry = ElfModuleRegistry::getInstance();
+    size_t initial_count = registry.getModuleCount();
+    takeGraphEvents();
+
+    ElfModuleLoader loader(getGraphShims());
+    loader.addSearchPath(directory);
+    shared_ptr<ElfModule> root = registry.open(directory + "/libgraph-root.so", loader);
+    check(takeGraphEvents() == vector<int>({1, 2}), "a registry load initializes the whole graph");
+    check(registry.getModuleCount() == initial_count + 2, "the registry holds the root and its dependency");
+
+    shared_ptr<ElfModule> dep = registry.open(directory + "/libgraph-dep.so", getGraphShims());
+    check(takeGraphEvents().empty(), "opening a loaded dependency shares it");
+    check(registry.getModuleCount() == initial_count + 2, "sharing adds nothing to the registry");
+
+    root.reset();
+    check(takeGraphEvents() == vector<int>({-2}), "the root is finalized while its dependency is still open");
+    dep.reset();
+    check(takeGraphEvents() == vector<int>({-1}), "the dependency is finalized with its last handle");
+    check(registry.getModuleCount() == initial_count, "released modules leave the registry");
+
+    // Nothing tells this load where libgraph-dep.so is so its import has to come from the shims
+    ElfModule::DynamicShims shims = getGraphShims();
+    shims["dep_value"] = (const void*)fallbackValue;
+    shared_ptr<ElfModule> alone = registry.open(directory + "/libgraph-root.so", shims);
+    check(
+        ((ValueFunction)alone->getSymbolAddress("root_value"))() == 7, "a DT_NEEDED name nothing resolves is left to the shims"
+    );
+    alone.reset();
+    check(takeGraphEvents() == vector<int>({2, -2}), "a lone registry module is initialized and finalized");
+}
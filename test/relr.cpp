@@ -0,0 +1,35 @@
+#include <string>
+#include "elf_header_view.h"
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks DT_RELR packed relocations are applied, both with the loading thread and with several
+
+typedef SYSV int (*ValueFunction)();
+
+void testRelr(const string &directory) {
+    string path = directory + "/librelr.so";
+    bool has_relr = false;
+    bool has_rela = false;
+    ElfHeaderView view(path);
+    for(const Elf64_Dyn &entry : view.getDynamicEntries()) {
+        has_relr |= entry.d_tag == DT_RELR;
+        has_rela |= entry.d_tag == DT_RELASZ && entry.d_un.d_val;
+    }
+    check(has_relr && !has_rela, "the fixture's pointers are only in DT_RELR");
+
+    ElfModule::DynamicShims shims;
+    ElfModule module(shims, path);
+    check(!module.getPackedRelocations().empty(), "the packed relocations are loaded");
+    check(((ValueFunction)module.getSymbolAddress("relr_correct"))() == 101, "every packed relocation is applied");
+
+    ElfLoadOptions options;
+    options.relocation_threads = 4;
+    options.relocation_chunk_size = 8;
+    ElfModule threaded(shims, path, options);
+    check(
+        ((ValueFunction)threaded.getSymbolAddress("relr_correct"))() == 101,
+        "every packed relocation is applied when relocating on several threads"
+    );
+}
@@ -0,0 +1,39 @@
+#include <cstring>
+#include <memory>
+#include <string>
+#include "exceptions.h"
+#include "elf_module.h"
+#include "elf_module_loader.h"
+#include "elf_symbol_scope.h"
+#include "test.h"
+using namespace std;
+
+// Checks that a module's imports only bind to what its dependencies export
+
+void testScope(const string &directory) {
+    ElfModule::DynamicShims shims;
+
+    ElfModule dep(shims, directory + "/libscope-dep.so");
+    check(dep.getSymbolAddress("helper") != nullptr, "the image still finds its own local in .symtab");
+    check(dep.getSymbolAddress("hidden_fn") != nullptr, "the image still finds its own hidden symbol");
+
+    ElfSymbolScope scope(shims);
+    scope.addImage(&dep);
+    const void *address;
+    check(!scope.find("helper", address), "a local definition isn't visible through the scope");
+    check(!scope.find("hidden_fn", address), "a hidden definition isn't visible through the scope");
+    check(
+        scope.find("dep_value", address) && address == dep.getSymbolAddress("dep_value"),
+        "an exported definition is visible through the scope"
+    );
+
+    ElfModuleLoader loader(shims);
+    loader.addSearchPath(directory);
+    bool unresolved = false;
+    try {
+        loader.load(directory + "/libscope-root.so");
+    } catch(const UnresolvedSymbol &error) {
+        unresolved = strstr(error.what(), "helper") || strstr(error.what(), "hidden_fn");
+    }
+    check(unresolved, "imports of a dependency's local and hidden symbols stay unresolved");
+}
@@ -0,0 +1,57 @@
+#include <string>
+#include <string_view>
+#include "exceptions.h"
+#include "elf_module.h"
+#include "elf_shim_table.h"
+#include "test.h"
+using namespace std;
+
+// Checks both kinds of shim table find what they hold, and that a perfect hashed one can stand in for the other
+
+typedef SYSV int (*ValueFunction)();
+
+static SYSV void ignoreEvent(int) { }
+
+static constexpr string_view static_names[] = {"record_event", "printf", "puts", "malloc", "free"};
+static constexpr ElfStaticShims<5> static_shims(static_names);
+
+void testShims(const string &directory) {
+    ElfShimTable table;
+    static const int values[200] = {};
+    for(int i = 0; i < 200; i++) {
+        table.insert("shim_" + to_string(i), &values[i]);
+    }
+    bool all_found = true;
+    for(int i = 0; i < 200; i++) {
+        const void *address = nullptr;
+        all_found &= table.find("shim_" + to_string(i), address) && address == &values[i];
+    }
+    check(all_found, "every name inserted is found after the table grew");
+    const void *address;
+    check(!table.find("shim_200", address), "a name never inserted isn't found");
+    table.insert("shim_0", &values[1]);
+    check(table.size() == 200 && table.find("shim_0", address) && address == &values[1], "insert replaces an address");
+
+    for(size_t i = 0; i < static_shims.size(); i++) {
+        all_found &= static_shims.indexOf(static_names[i]) == i;
+    }
+    check(all_found, "the perfect hash sends every name to its own index");
+    check(static_shims.indexOf("strlen") == static_shims.size(), "the perfect hash rejects names outside the set");
+
+    const void *const addresses[] = {(const void*)ignoreEvent, &values[1], &values[2], &values[3], &values[4]};
+    ElfShimTable frozen(static_shims, addresses);
+    check(frozen.find("puts", address) && address == &values[2], "a table built from the set finds its names");
+    check(!frozen.find("strlen", address), "a table built from the set doesn't find other names");
+    bool threw = false;
+    try {
+        frozen["strlen"] = nullptr;
+    } catch(const FrozenShimTable&) {
+        threw = true;
+    }
+    check(threw, "a table built from the set can't be changed");
+
+    ElfModule module(frozen, directory + "/libgraph-dep.so");
+    module.initialize();
+    check(((ValueFunction)module.getSymbolAddress("dep_value"))() == 42, "a module binds to shims from the set");
+    module.finalize();
+}
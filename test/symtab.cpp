@@ -0,0 +1,27 @@
+#include <string>
+#include "elf_module.h"
+#include "test.h"
+using namespace std;
+
+// Checks lookups in .symtab, which go through the index the loader builds for tables without a hash table
+
+typedef SYSV int (*ValueFunction)();
+
+void testSymtab(const string &directory) {
+    ElfModule::DynamicShims shims;
+    ElfModule module(shims, directory + "/libsymtab.so");
+    bool all_found = true;
+    bool none_exported = true;
+    for(int i = 10; i < 50; i++) {
+        string name = "symtab_hidden_" + to_string(i);
+        ValueFunction function = (ValueFunction)module.getSymbolAddress(name);
+        all_found &= function && function() == i;
+        none_exported &= !module.getExportedSymbolAddress(name.c_str(), elfGnuHash(name.c_str()));
+    }
+    check(none_exported, "hidden definitions are only in .symtab");
+    check(all_found, "every definition in .symtab is found through the index");
+    check(
+        !module.getSymbolAddress("symtab_hidden_50") && !module.getSymbolAddress("symtab_hidden_1"),
+        "names .symtab doesn't have miss the index"
+    );
+}
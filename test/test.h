@@ -0,0 +1,37 @@
+#ifndef __INC_TEST_H_
+#define __INC_TEST_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "elf_module.h"
+
+// Records one check, any failure makes `make test` fail
+void check(bool condition, const char *description);
+// The whole file in one buffer
+std::shared_ptr<char[]> readFile(const std::string &path, size_t &size);
+
+// Each takes the directory `make test` built test/fixtures into
+void testScope(const std::string &directory);
+void testGraph(const std::string &directory);
+void testAsync(const std::string &directory);
+void testRegistry(const std::string &directory);
+void testCache(const std::string &directory);
+void testBss(const std::string &directory);
+void testShims(const std::string &directory);
+void testHash(const std::string &directory);
+void testSymtab(const std::string &directory);
+void testRelr(const std::string &directory);
+void testLazy(const std::string &directory);
+void testBuffer(const std::string &directory);
+void testBatch(const std::string &directory);
+void testAddress(const std::string &directory);
+void testLazySections(const std::string &directory);
+void testHeaderView(const std::string &directory);
+
+// Shims for test/fixtures/graph-*.cpp, their constructors and destructors record +/-1 for the dependency and
+// +/-2 for the root
+ElfModule::DynamicShims getGraphShims();
+std::vector<int> takeGraphEvents();
+
+#endif//__INC_TEST_H_